@@ -0,0 +1,230 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ErrorHandler.h"
+
+/**
+ * Extension of the files the results are written into, such files are left out when a directory is listed
+ */
+constexpr const char* output_extension = ".out";
+
+/**
+ * A file of the batch and the path its result is written into
+ */
+struct batch_file
+{
+	std::string input;
+	std::string output;
+};
+
+/**
+ * @return True if the name matches the pattern, '*' stands for any run of characters and '?' for any one character
+ */
+inline bool matches_wildcard(const std::string& name, const std::string& pattern)
+{
+	size_t n = 0, p = 0;
+	size_t star = std::string::npos, resume = 0;
+
+	while (n < name.size())
+	{
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+		{
+			n++;
+			p++;
+		}
+		else if (p < pattern.size() && pattern[p] == '*')
+		{
+			star = p++;
+			resume = n;
+		}
+		else if (star != std::string::npos)
+		{
+			p = star + 1;
+			n = ++resume;
+		}
+		else
+			return false;
+	}
+
+	while (p < pattern.size() && pattern[p] == '*')
+		p++;
+
+	return p == pattern.size();
+}
+
+/**
+ * Adds the regular files of the directory whose names match the pattern, in the order of their names
+ */
+inline void add_directory_files(const std::filesystem::path& directory, const std::string& pattern,
+                                std::vector<std::string>& files)
+{
+	std::error_code error;
+	std::vector<std::string> found;
+
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file(error))
+			continue;
+
+		const auto name = entry.path().filename().string();
+
+		if (name.size() >= strlen(output_extension) &&
+			name.compare(name.size() - strlen(output_extension), std::string::npos, output_extension) == 0)
+			continue;
+
+		if (matches_wildcard(name, pattern))
+			found.push_back(entry.path().string());
+	}
+
+	if (error)
+		throw_error(errors::input_file_error);
+
+	std::sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+}
+
+/**
+ * Expands one input of the batch mode into the files it stands for:\n
+ * '@list.txt' - the files listed in the file, one per line\n
+ * directory - the files of the directory, except for the results of previous runs\n
+ * pattern with '*' or '?' in the file name - the matching files of its directory\n
+ * anything else - the file itself
+ */
+inline void add_batch_input(const std::string& input, std::vector<std::string>& files)
+{
+	if (!input.empty() && input[0] == '@')
+	{
+		std::ifstream list(input.substr(1));
+
+		if (!list)
+			throw_error(errors::input_file_error);
+
+		std::string line;
+
+		while (std::getline(list, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if (!line.empty())
+				files.push_back(line);
+		}
+
+		return;
+	}
+
+	const std::filesystem::path path(input);
+	const auto name = path.filename().string();
+
+	if (name.find_first_of("*?") != std::string::npos)
+	{
+		add_directory_files(path.has_parent_path() ? path.parent_path() : std::filesystem::path("."), name, files);
+		return;
+	}
+
+	std::error_code error;
+
+	if (std::filesystem::is_directory(path, error))
+		add_directory_files(path, "*", files);
+	else
+		files.push_back(input);
+}
+
+/**
+ * @return Absolute path of the file with the links, '.' and '..' resolved as far as the file exists
+ */
+inline std::filesystem::path canonical_path(const std::string& file)
+{
+	std::error_code error;
+	auto path = std::filesystem::weakly_canonical(file, error);
+
+	if (error)
+		path = std::filesystem::absolute(file, error).lexically_normal();
+
+	return path;
+}
+
+/**
+ * Pairs every file of the batch with the path of its result, before any file is processed:\n
+ * the same file given more than once (as 'x.txt' and './x.txt', by a list and a pattern, ...) is kept once\n
+ * without an output directory the result is '<file>.out' next to the file, otherwise the path of the file relative
+ * to the current directory is mirrored under the output directory (files outside of it keep their whole path
+ * without the root) and the directories are created\n
+ * Two files sharing a result, or a result overwriting a file of the batch, are reported and end the program
+ */
+inline std::vector<batch_file> plan_batch(const std::vector<std::string>& files, const std::string& output_directory)
+{
+	std::vector<batch_file> batch;
+	std::set<std::filesystem::path> inputs, outputs;
+
+	std::error_code error;
+	const auto current = std::filesystem::current_path(error);
+	const auto directory = output_directory.empty() ? std::filesystem::path() : canonical_path(output_directory);
+
+	for (const auto& file : files)
+	{
+		const auto input = canonical_path(file);
+
+		if (!inputs.insert(input).second)
+			continue;
+
+		if (output_directory.empty())
+		{
+			batch.push_back({file, file + output_extension});
+			continue;
+		}
+
+		auto relative = input.lexically_relative(current);
+
+		if (relative.empty() || *relative.begin() == "..")
+		{
+			// The drive or server name becomes the first directory
+			auto root = input.root_name().string();
+			root.erase(std::remove_if(root.begin(), root.end(), [](const char c)
+			{
+				return c == ':' || c == '\\' || c == '/';
+			}), root.end());
+
+			relative = std::filesystem::path(root) / input.relative_path();
+		}
+
+		batch.push_back({file, (directory / relative).string() + output_extension});
+	}
+
+	for (const auto& [input, output] : batch)
+	{
+		const auto path = output_directory.empty() ? canonical_path(output) : std::filesystem::path(output);
+
+		if (!outputs.insert(path).second || inputs.count(path) != 0)
+		{
+			std::wcerr << L"\tFile:\t" << input.c_str() << L"\tits result " << output.c_str()
+				<< L" collides with another file of the batch\n";
+			throw_error(errors::output_file_error);
+		}
+	}
+
+	if (!output_directory.empty())
+	{
+		std::set<std::filesystem::path> directories;
+
+		for (const auto& file : batch)
+			directories.insert(std::filesystem::path(file.output).parent_path());
+
+		for (const auto& path : directories)
+		{
+			std::filesystem::create_directories(path, error);
+
+			if (error)
+				throw_error(errors::output_file_error);
+		}
+	}
+
+	return batch;
+}
@@ -0,0 +1,334 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MatchKernel.h"
+#include "WideCharUtilities.h"
+
+namespace
+{
+	/**
+	 * The former loop of search_model_for - the arity is checked for every record
+	 */
+	int32_t reference_lookup(const block_view& block, const int arg_count, const int32_t first_w,
+	                         const int32_t third_w, std::vector<int32_t>& counts)
+	{
+		auto individual_count = 0;
+
+		for (size_t i = 0; i < block.size(); i++)
+		{
+			switch (arg_count)
+			{
+			case 1:
+				individual_count += block.count(i);
+				break;
+			case 2:
+				if (first_w == block.first(i))
+					counts.push_back(block.count(i));
+				break;
+			case 3:
+				if (first_w == block.first(i) && third_w == block.third(i))
+					counts.push_back(block.count(i));
+				break;
+			default:
+				throw;
+			}
+		}
+
+		return individual_count;
+	}
+
+	int32_t kernel_lookup(const kernel_set& kernels, const block_view& block, const int arg_count,
+	                      const int32_t first_w, const int32_t third_w, std::vector<int32_t>& counts)
+	{
+		switch (arg_count)
+		{
+		case 1:
+			return kernels.unigram(block);
+		case 2:
+			kernels.bigram(block, first_w, 0, counts);
+			return 0;
+		case 3:
+			kernels.trigram(block, first_w, third_w, counts);
+			return 0;
+		default:
+			throw;
+		}
+	}
+
+	/**
+	 * @return Nanoseconds per record of 'lookup' averaged over enough repetitions to scan about 32M records
+	 */
+	template <typename Lookup>
+	double measure(const block_view& block, Lookup&& lookup, int64_t& checksum)
+	{
+		const auto repetitions = block.size() < (1u << 25) ? (1u << 25) / block.size() : 1;
+		std::vector<int32_t> counts;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (size_t r = 0; r < repetitions; r++)
+		{
+			counts.clear();
+			checksum += lookup(static_cast<int32_t>(r % 64 + 1), static_cast<int32_t>(r % 16 + 1), counts);
+			checksum += static_cast<int64_t>(counts.size());
+
+			for (const auto count : counts)
+				checksum += count;
+		}
+
+		const auto end = std::chrono::steady_clock::now();
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / (repetitions * block.size());
+	}
+
+	/**
+	 * @return Nanoseconds per word of 'lookup' over all queries, every id found is folded into the checksum
+	 */
+	template <typename Lookup>
+	double measure_variants(std::vector<std::wstring>& queries, Lookup&& lookup, int64_t& checksum)
+	{
+		std::vector<int32_t> ids;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (auto& query : queries)
+		{
+			lookup(query, ids);
+
+			for (const auto id : ids)
+				checksum = checksum * 31 + id;
+		}
+
+		const auto end = std::chrono::steady_clock::now();
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / queries.size();
+	}
+}
+
+void run_kernel_benchmark()
+{
+	const auto detected = detect_simd_level();
+
+	std::vector<kernel_set> kernel_sets{get_kernels(simd_level::scalar)};
+
+	if (detected >= simd_level::sse2)
+		kernel_sets.push_back(get_kernels(simd_level::sse2));
+	if (detected >= simd_level::avx2)
+		kernel_sets.push_back(get_kernels(simd_level::avx2));
+
+	std::wcerr << L"*** Context matching kernels (detected: " << get_kernels(detected).name << L") ***\n"
+		<< L"ns per record, the reference is the former per-record loop\n\n";
+
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<int32_t> first_words(1, 64), third_words(1, 16), counts(1, 1000);
+
+	const wchar_t* arities[] = {L"unigram", L"bigram", L"trigram"};
+
+	for (const size_t size : {16u, 256u, 4096u, 65536u})
+	{
+		std::vector<model_record> rows(size);
+
+		for (auto& record : rows)
+			record = model_record{1, first_words(generator), third_words(generator), counts(generator)};
+
+		std::vector<int32_t> columns(3 * size);
+
+		for (size_t i = 0; i < size; i++)
+		{
+			columns[i] = rows[i].first_w;
+			columns[size + i] = rows[i].third_w;
+			columns[2 * size + i] = rows[i].count;
+		}
+
+		const block_view layouts[] = {
+			block_view(record_span(rows.data(), rows.data() + size)),
+			block_view(columns.data(), columns.data() + size, columns.data() + 2 * size, 1, size)
+		};
+
+		for (auto layout = 0; layout < 2; layout++)
+		{
+			const auto& block = layouts[layout];
+
+			for (auto arg_count = 1; arg_count <= 3; arg_count++)
+			{
+				int64_t reference_checksum = 0;
+
+				const auto reference = measure(block, [&](const int32_t first_w, const int32_t third_w,
+				                                          std::vector<int32_t>& matched)
+				{
+					return reference_lookup(block, arg_count, first_w, third_w, matched);
+				}, reference_checksum);
+
+				std::wcerr << std::setw(8) << (layout == 0 ? L"rows" : L"columns") << std::setw(7) << size
+					<< std::setw(9) << arities[arg_count - 1] << L"  reference " << std::fixed
+					<< std::setprecision(3) << reference;
+
+				for (const auto& kernels : kernel_sets)
+				{
+					int64_t checksum = 0;
+
+					const auto time = measure(block, [&](const int32_t first_w, const int32_t third_w,
+					                                     std::vector<int32_t>& matched)
+					{
+						return kernel_lookup(kernels, block, arg_count, first_w, third_w, matched);
+					}, checksum);
+
+					std::wcerr << L"  " << kernels.name << L" " << time << L" (x" << std::setprecision(2)
+						<< reference / time << L")" << std::setprecision(3);
+
+					if (checksum != reference_checksum)
+						std::wcerr << L" MISMATCH";
+				}
+
+				std::wcerr << L"\n";
+			}
+		}
+	}
+
+	std::wcerr << L"\nns per lookup in sorted columnar blocks, full scan against the fenced binary search\n\n";
+
+	const auto& kernels = active_kernels();
+
+	for (const size_t size : {4096u, 65536u, 1048576u})
+	{
+		std::vector<model_record> records(size);
+
+		for (auto& record : records)
+			record = model_record{1, first_words(generator), third_words(generator), counts(generator)};
+
+		sort_block_records(records);
+
+		std::vector<int32_t> columns(3 * size);
+
+		for (size_t i = 0; i < size; i++)
+		{
+			columns[i] = records[i].first_w;
+			columns[size + i] = records[i].third_w;
+			columns[2 * size + i] = records[i].count;
+		}
+
+		for (size_t i = 0; i < size; i += fence_interval)
+			columns.push_back(records[i].first_w);
+
+		auto block = block_view(columns.data(), columns.data() + size, columns.data() + 2 * size, 1, size);
+		block.set_sorted(columns.data() + 3 * size, (columns.size() - 3 * size));
+
+		for (auto arg_count = 2; arg_count <= 3; arg_count++)
+		{
+			int64_t scan_checksum = 0, narrowed_checksum = 0;
+
+			const auto scan = measure(block, [&](const int32_t first_w, const int32_t third_w,
+			                                     std::vector<int32_t>& matched)
+			{
+				return kernel_lookup(kernels, block, arg_count, first_w, third_w, matched);
+			}, scan_checksum) * size;
+
+			const auto narrowed = measure(block, [&](const int32_t first_w, const int32_t third_w,
+			                                         std::vector<int32_t>& matched)
+			{
+				const auto context = arg_count == 2
+					                     ? narrow_block(block, first_w)
+					                     : narrow_block(block, first_w, third_w);
+
+				return kernel_lookup(kernels, context, arg_count, first_w, third_w, matched);
+			}, narrowed_checksum) * size;
+
+			std::wcerr << std::setw(8) << size << std::setw(9) << arities[arg_count - 1] << L"  scan "
+				<< std::setprecision(1) << scan << L"  narrowed " << narrowed << L" (x" << scan / narrowed << L")";
+
+			if (scan_checksum != narrowed_checksum)
+				std::wcerr << L" MISMATCH";
+
+			std::wcerr << L"\n";
+		}
+	}
+}
+
+void run_dictionary_benchmark(const word_mapping& wm, const folded_index& fi, const dawg_dictionary& dawg)
+{
+	std::wcerr << L"\n*** Diacritic variants of " << wm.size() << L" dictionary words stripped of diacritics ***\n"
+		<< L"ns per word, the reference is the recursive generator probing the hash for every combination\n\n";
+
+	std::vector<std::wstring> queries;
+	queries.reserve(wm.size());
+
+	for (size_t id = 1; id <= wm.size(); id++)
+	{
+		std::wstring word(wm.int_to_word(static_cast<int>(id)));
+
+		for (auto& c : word)
+			c = fold_letter(c);
+
+		queries.push_back(std::move(word));
+	}
+
+	if (queries.empty())
+		return;
+
+	int64_t reference_checksum = 0, folded_checksum = 0, dawg_checksum = 0;
+
+	const auto reference = measure_variants(queries, [&](std::wstring& word, std::vector<int32_t>& ids)
+	{
+		ids.clear();
+
+		for (const auto& variant : get_variants(wm, word))
+		{
+			const auto mapped = wm.word_to_int(variant);
+
+			if (mapped != 0)
+				ids.push_back(mapped);
+		}
+	}, reference_checksum);
+
+	std::wcerr << L"  recursive " << std::fixed << std::setprecision(1) << reference;
+
+	if (!fi.empty())
+	{
+		const auto folded = measure_variants(queries, [&](std::wstring& word, std::vector<int32_t>& ids)
+		{
+			fi.variants(wm, word, ids);
+		}, folded_checksum);
+
+		std::wcerr << L"  folded index " << folded << L" (x" << reference / folded << L")";
+
+		if (folded_checksum != reference_checksum)
+			std::wcerr << L" MISMATCH";
+	}
+
+	if (!dawg.empty())
+	{
+		const auto automaton = measure_variants(queries, [&](std::wstring& word, std::vector<int32_t>& ids)
+		{
+			dawg.variants(word, ids);
+		}, dawg_checksum);
+
+		std::wcerr << L"  dawg " << automaton << L" (x" << reference / automaton << L")";
+
+		if (dawg_checksum != reference_checksum)
+			std::wcerr << L" MISMATCH";
+
+		size_t lookup_mismatches = 0;
+		std::wstring spelled;
+
+		for (size_t id = 1; id <= wm.size(); id++)
+		{
+			const auto word = wm.int_to_word(static_cast<int>(id));
+
+			if (dawg.word_to_int(word) != wm.word_to_int(word) || !dawg.int_to_word(static_cast<int>(id), spelled) ||
+				spelled != word)
+				lookup_mismatches++;
+		}
+
+		std::wcerr << L"\n\n  word <-> int mismatches " << lookup_mismatches;
+	}
+
+	std::wcerr << L"\n  memory: hashed dictionary " << wm.memory_size() / 1024 << L" KiB, dawg "
+		<< dawg.memory_size() / 1024 << L" KiB\n";
+}
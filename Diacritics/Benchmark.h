@@ -0,0 +1,18 @@
+#pragma once
+#include "DawgDictionary.h"
+#include "FoldedIndex.h"
+#include "LookupStructures.h"
+
+/**
+ * Compares the context matching kernels of every available instruction set against the per-record loop
+ * on synthetic blocks of both model layouts, as well as the binary search in sorted blocks against a full scan,
+ * and prints the timings to the standard error output
+ */
+void run_kernel_benchmark();
+
+/**
+ * Compares the recursive diacritic variant generator against the folded index and the dictionary automaton
+ * on the words of the installed dictionary stripped of their diacritics, checks that all of them find the same
+ * variants and prints the timings and the memory taken by the dictionary structures to the standard error output
+ */
+void run_dictionary_benchmark(const word_mapping& wm, const folded_index& fi, const dawg_dictionary& dawg);
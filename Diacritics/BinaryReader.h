@@ -3,10 +3,61 @@
 #include <cstdint>
 #include <string>
 #include <fstream>
+#include <vector>
 #include "MemoryMap.h"
+#include "ErrorHandler.h"
 
 extern const char* model_name;
 
+/**
+ * A single 16B record of the model file - the middle word, its context words and the triplet count
+ */
+struct model_record
+{
+	int32_t second_w;
+	int32_t first_w;
+	int32_t third_w;
+	int32_t count;
+};
+
+static_assert(sizeof(model_record) == 4 * 4, "The model file consists of 16B records");
+
+/**
+ * A non-owning range of model records, usually pointing directly into a memory mapped model file
+ */
+class record_span
+{
+	const model_record* begin_ = nullptr;
+	const model_record* end_ = nullptr;
+
+public:
+	record_span() = default;
+
+	record_span(const model_record* begin, const model_record* end) : begin_(begin), end_(end)
+	{
+	}
+
+	[[nodiscard]] const model_record* begin() const
+	{
+		return begin_;
+	}
+
+	[[nodiscard]] const model_record* end() const
+	{
+		return end_;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return end_ - begin_;
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return begin_ == end_;
+	}
+};
+
 class binary_reader
 {
 public:
@@ -20,6 +71,14 @@ public:
 
 	virtual int32_t read_4_bytes() = 0;
 	virtual void seek(long long offset, std::ios::_Seekdir direction) = 0;
+
+	/**
+	 * Reads 'record_count' of records starting at the 'first_record' index in a single call
+	 *
+	 * @param buffer Reusable storage for readers that have to copy the data, left untouched otherwise
+	 * @return The requested records, empty if the range is not a part of the file
+	 */
+	virtual record_span read_block(size_t first_record, size_t record_count, std::vector<model_record>& buffer) = 0;
 };
 
 /**
@@ -31,11 +90,11 @@ class ifstream_binary_reader final : public binary_reader
 
 public:
 
-	explicit ifstream_binary_reader(const std::string& filename) : ifs_(std::ifstream(model_name, std::ios::binary)) { }
+	explicit ifstream_binary_reader(const std::string& filename) : ifs_(std::ifstream(filename, std::ios::binary)) { }
 
 	int32_t read_4_bytes() override
-	{	
-		int32_t value;
+	{
+		int32_t value = 0;
 		ifs_.read(reinterpret_cast<char*>(&value), sizeof value);
 
 		return value;
@@ -43,36 +102,52 @@ public:
 
 	void seek(const long long offset, const std::ios::_Seekdir direction) override
 	{
-		
+
 		ifs_.seekg(offset, direction);
 	}
+
+	record_span read_block(const size_t first_record, const size_t record_count,
+	                       std::vector<model_record>& buffer) override
+	{
+		buffer.resize(record_count);
+
+		ifs_.seekg(first_record * sizeof(model_record), std::ios::beg);
+		ifs_.read(reinterpret_cast<char*>(buffer.data()), record_count * sizeof(model_record));
+
+		const auto records_read = static_cast<size_t>(ifs_.gcount()) / sizeof(model_record);
+
+		return {buffer.data(), buffer.data() + records_read};
+	}
 };
 
 /**
- * A 'memory mapped' binary reader that uses the process memory to cache previously read segments.
+ * A binary reader over a memory mapped file - reads are plain pointer arithmetic into the mapped pages.
  */
 class mmap_binary_reader final : public binary_reader
 {
-	mem_map& mm_;
+	const mem_map& mm_;
 	size_t offset_ = 0;
-	
+
 public:
 
-	explicit mmap_binary_reader(mem_map& mm) : mm_(mm)
+	explicit mmap_binary_reader(const mem_map& mm) : mm_(mm)
 	{
 	}
 
 	int32_t read_4_bytes() override
-	{	
-		int32_t value;
-		mm_.read(reinterpret_cast<char*>(&value), sizeof value, offset_);
+	{
+		int32_t value = 0;
+
+		if (offset_ + sizeof value <= mm_.size())
+			memcpy(&value, mm_.data() + offset_, sizeof value);
+
 		offset_ += sizeof value;
 
 		return value;
 	}
 
 	void seek(const long long offset, const std::ios::_Seekdir direction) override
-	{	
+	{
 		switch (direction)
 		{
 			case std::ios::_Seekbeg:
@@ -82,13 +157,28 @@ public:
 			case std::ios::_Seekcur:
 				offset_ += offset;
 				break;
-			
+
 			case std::ios::_Seekend:
 				offset_ = mm_.size() + offset;
-				break; 
+				break;
 
 			default:
 				throw_error(errors::model_error);
 		}
 	}
-};
\ No newline at end of file
+
+	/**
+	 * Does not copy anything - the returned span points directly into the mapped file
+	 */
+	record_span read_block(const size_t first_record, const size_t record_count,
+	                       std::vector<model_record>&) override
+	{
+		const auto first = reinterpret_cast<const model_record*>(
+			mm_.block(first_record * sizeof(model_record), record_count * sizeof(model_record)));
+
+		if (!first)
+			return {};
+
+		return {first, first + record_count};
+	}
+};
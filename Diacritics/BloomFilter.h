@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "MemoryMap.h"
+
+/**
+ * Header of the context filter, followed by UINT64[block_count * bloom_block_words] - the bits of all blocks
+ */
+struct bloom_filter_header
+{
+	char magic[8];
+	uint32_t word_count;
+	uint32_t block_count;
+	uint64_t model_fingerprint;
+};
+
+static const char bloom_filter_magic[8] = {'D', 'I', 'A', 'C', 'B', 'L', 'M', '2'};
+
+/**
+ * Every key sets its bits in a single 512-bit block, so a lookup touches one cache line
+ */
+constexpr uint32_t bloom_block_words = 8;
+constexpr uint32_t bloom_hash_count = 8;
+
+/**
+ * Filter bits reserved for every key, about 0.1 % of false positives
+ */
+constexpr uint32_t bloom_bits_per_key = 16;
+
+/**
+ * Blocked Bloom filter over the contexts present in the trigram model - (first, second, third) triplets
+ * and (first, second) pairs, so that the blocks are not searched for contexts the model does not have\n
+ * The filter has no false negatives, a context it rejects is certainly missing from the model
+ */
+class bloom_filter
+{
+	mem_map mm_;
+	const bloom_filter_header* header_ = nullptr;
+	const uint64_t* blocks_ = nullptr;
+
+public:
+	/**
+	 * @return Hash of a triplet, pairs are hashed with the third word 0 that no word has
+	 */
+	static uint64_t hash_context(const int32_t first_w, const int32_t second_w, const int32_t third_w = 0)
+	{
+		auto h = (static_cast<uint64_t>(static_cast<uint32_t>(first_w)) << 32 | static_cast<uint32_t>(second_w)) *
+			0x9e3779b97f4a7c15ULL;
+
+		h ^= static_cast<uint64_t>(static_cast<uint32_t>(third_w)) * 0xc2b2ae3d27d4eb4fULL;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+
+		return h;
+	}
+
+	/**
+	 * Calls 'bit' with the word and the mask of every bit the hash sets in its block (double hashing)
+	 */
+	template <typename Bit>
+	static void for_each_bit(const uint64_t hash, Bit&& bit)
+	{
+		const auto first = static_cast<uint32_t>(hash);
+		const auto step = static_cast<uint32_t>(hash >> 9) | 1;
+
+		for (uint32_t i = 0; i < bloom_hash_count; i++)
+		{
+			const auto position = (first + i * step) & (bloom_block_words * 64 - 1);
+
+			bit(position / 64, 1ULL << position % 64);
+		}
+	}
+
+	/**
+	 * @return First word of the block the hash falls into, the block is selected by the upper half of the hash
+	 */
+	static uint32_t block_of(const uint64_t hash, const uint32_t block_count)
+	{
+		return static_cast<uint32_t>((hash >> 32) & (block_count - 1)) * bloom_block_words;
+	}
+
+	bloom_filter() = default;
+
+	/**
+	 * Maps the filter, the object evaluates to false if the file is missing, damaged or made for another dictionary
+	 * or model (see model_fingerprint)
+	 */
+	bloom_filter(const std::string& file_name, const size_t word_count, const uint64_t fingerprint) : mm_(file_name)
+	{
+		const auto header = reinterpret_cast<const bloom_filter_header*>(mm_.block(0, sizeof(bloom_filter_header)));
+
+		if (!header || memcmp(header->magic, bloom_filter_magic, sizeof bloom_filter_magic) != 0 ||
+			header->word_count != word_count || header->model_fingerprint != fingerprint || header->block_count == 0 ||
+			(header->block_count & (header->block_count - 1)) != 0)
+			return;
+
+		blocks_ = reinterpret_cast<const uint64_t*>(mm_.block(
+			sizeof(bloom_filter_header), static_cast<size_t>(header->block_count) * bloom_block_words * sizeof(uint64_t)));
+
+		if (blocks_)
+			header_ = header;
+	}
+
+	explicit operator bool() const
+	{
+		return header_ != nullptr;
+	}
+
+	/**
+	 * @return False if the context is certainly not in the model
+	 */
+	[[nodiscard]] bool may_contain(const int32_t first_w, const int32_t second_w, const int32_t third_w = 0) const
+	{
+		const auto hash = hash_context(first_w, second_w, third_w);
+		const auto block = blocks_ + block_of(hash, header_->block_count);
+
+		auto present = true;
+
+		for_each_bit(hash, [&](const uint32_t word, const uint64_t mask)
+		{
+			present &= (block[word] & mask) != 0;
+		});
+
+		return present;
+	}
+};
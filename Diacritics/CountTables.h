@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "MemoryMap.h"
+
+/**
+ * Header of the precomputed count tables, the sections that follow are:\n
+ * unigrams - INT32[word_count + 1], the sum of the counts in the block of the middle word with the int code i\n
+ * bigram_offsets - UINT32[word_count + 2], bigrams of the middle word i span [bigram_offsets[i], bigram_offsets[i + 1])\n
+ * bigram_first - INT32[bigram_count], the preceding words, sorted within every middle word\n
+ * bigram_counts - INT32[bigram_count], the highest triplet count of every (preceding word, middle word) pair
+ */
+struct count_tables_header
+{
+	char magic[8];
+	uint32_t word_count;
+	uint32_t bigram_count;
+	uint64_t model_fingerprint;
+};
+
+static const char count_tables_magic[8] = {'D', 'I', 'A', 'C', 'C', 'N', 'T', '2'};
+
+/**
+ * Unigram and bigram counts of the model, so that the back-off lookups do not have to rescan the trigram blocks
+ */
+class count_tables
+{
+	mem_map mm_;
+	const count_tables_header* header_ = nullptr;
+	const int32_t* unigrams_ = nullptr;
+	const uint32_t* bigram_offsets_ = nullptr;
+	const int32_t* bigram_first_ = nullptr;
+	const int32_t* bigram_counts_ = nullptr;
+
+public:
+	count_tables() = default;
+
+	/**
+	 * Maps the tables, the object evaluates to false if the file is missing, damaged or made for another dictionary
+	 * or model (see model_fingerprint)
+	 */
+	count_tables(const std::string& file_name, const size_t word_count, const uint64_t fingerprint) : mm_(file_name)
+	{
+		const auto header = reinterpret_cast<const count_tables_header*>(mm_.block(0, sizeof(count_tables_header)));
+
+		if (!header || memcmp(header->magic, count_tables_magic, sizeof count_tables_magic) != 0 ||
+			header->word_count != word_count || header->model_fingerprint != fingerprint)
+			return;
+
+		const auto words = static_cast<size_t>(header->word_count);
+		const auto bigrams = static_cast<size_t>(header->bigram_count);
+
+		auto offset = sizeof(count_tables_header);
+
+		unigrams_ = reinterpret_cast<const int32_t*>(mm_.block(offset, (words + 1) * sizeof(int32_t)));
+		offset += (words + 1) * sizeof(int32_t);
+
+		bigram_offsets_ = reinterpret_cast<const uint32_t*>(mm_.block(offset, (words + 2) * sizeof(uint32_t)));
+		offset += (words + 2) * sizeof(uint32_t);
+
+		bigram_first_ = reinterpret_cast<const int32_t*>(mm_.block(offset, bigrams * sizeof(int32_t)));
+		offset += bigrams * sizeof(int32_t);
+
+		bigram_counts_ = reinterpret_cast<const int32_t*>(mm_.block(offset, bigrams * sizeof(int32_t)));
+
+		if (unigrams_ && bigram_offsets_ && (bigrams == 0 || (bigram_first_ && bigram_counts_)) &&
+			bigram_offsets_[words + 1] == bigrams)
+			header_ = header;
+	}
+
+	explicit operator bool() const
+	{
+		return header_ != nullptr;
+	}
+
+	/**
+	 * @return Sum of all triplet counts of the middle word
+	 */
+	[[nodiscard]] int32_t unigram(const int second_w) const
+	{
+		if (second_w <= 0 || static_cast<uint32_t>(second_w) > header_->word_count)
+			return 0;
+
+		return unigrams_[second_w];
+	}
+
+	/**
+	 * Looks up the highest triplet count of the (first_w, second_w) pair
+	 *
+	 * @return False if the pair does not occur in the model
+	 */
+	bool bigram(const int second_w, const int first_w, int32_t& count) const
+	{
+		if (second_w <= 0 || static_cast<uint32_t>(second_w) > header_->word_count)
+			return false;
+
+		const auto first = bigram_offsets_[second_w];
+		const auto last = std::min(bigram_offsets_[second_w + 1], header_->bigram_count);
+
+		if (first >= last)
+			return false;
+
+		const auto end = bigram_first_ + last;
+		const auto it = std::lower_bound(bigram_first_ + first, end, first_w);
+
+		if (it == end || *it != first_w)
+			return false;
+
+		count = bigram_counts_[it - bigram_first_];
+
+		return true;
+	}
+};
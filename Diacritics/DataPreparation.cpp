@@ -3,7 +3,25 @@
 #include <fstream>
 #include <set>
 #include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_map>
 #include "ErrorHandler.h"
+#include "WideCharUtilities.h"
+#include "TrigramModel.h"
+#include "CountTables.h"
+#include "FoldedIndex.h"
+#include "DawgDictionary.h"
+#include "DecisionTable.h"
+#include "BloomFilter.h"
+
+extern const char* model_name;
+extern const char* varint_model_name;
+extern const char* columnar_model_name;
+extern const char* offset_model_name;
+extern const char* binary_offset_model_name;
 
 /**
  * Merges two files into one that is stored separately, stores only unique std::wstring value
@@ -82,6 +100,7 @@ mutable_offset_table generate_compressed_model(const std::string& filename)
 
 	auto key_numeric = 1;
 	auto count = 0;
+	auto block_start = 0;
 	std::wstring current_line, key;
 
 	while (std::getline(wif, current_line))
@@ -92,11 +111,12 @@ mutable_offset_table generate_compressed_model(const std::string& filename)
 
 		if (key_numeric != stoi(key))
 		{
-			m.insert(key_numeric, count);
+			m.insert(key_numeric, block_start, count - block_start);
 
 			wof << key_numeric << L"\n" << count << L"\n";
 
 			key_numeric = stoi(key);
+			block_start = count;
 		}
 		count++;
 	}
@@ -162,7 +182,7 @@ mutable_offset_table load_compressed_model(const std::string& filename)
 
 	while (iff >> key >> count)
 	{
-		mutable_m.insert(key, prev_count);
+		mutable_m.insert(key, prev_count, count - prev_count);
 		prev_count = count;
 	}
 
@@ -172,38 +192,1200 @@ mutable_offset_table load_compressed_model(const std::string& filename)
 }
 
 /**
- * Loads the contents of a dictionary into a word_mapping object
+ * Dumps an offset table into the binary offset file - a header followed by a dense array of model blocks
  *
- * @param filename Path to the dictionary file
- * @return Mutable copy of a bimap of the dictionary
+ * @param m Offset table, usually loaded from the text offset file
+ * @param filename Path, to which the binary offset file will be dumped
  */
-mutable_word_mapping load_word_mapping(const std::string& filename)
+void save_binary_offsets(const mutable_offset_table& m, const std::string& filename)
 {
-	mutable_word_mapping wm;
+	std::ofstream ofs(filename, std::ios::binary);
 
-	auto i = 1;
+	if (!ofs)
+		throw_error(errors::output_file_error);
 
-	std::wifstream wif(filename, std::ios::binary);
+	offset_file_header header{};
+	memcpy(header.magic, offset_file_magic, sizeof offset_file_magic);
+	header.entry_count = static_cast<uint32_t>(m.size());
 
-	if (!wif)
-		throw_error(errors::dictionary_error);
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(m.compressed_model.data()), m.size() * sizeof(model_block));
 
-	std::wstring current_word;
+	ofs.close();
+}
+
+/**
+ * Maps the binary offset file if it is present and valid, otherwise parses the text offset file
+ *
+ * @param binary_filename Path to the binary offset file (see save_binary_offsets)
+ * @param text_filename Path to the text offset file
+ * @return Offset table containing the model block of every word
+ */
+offset_table load_offset_table(const std::string& binary_filename, const std::string& text_filename)
+{
+	auto table = offset_table(mem_map(binary_filename));
+
+	if (!table.empty())
+		return table;
+
+	return offset_table(load_compressed_model(text_filename));
+}
+
+/**
+ * @return The smallest prime number greater or equal to n
+ */
+static uint32_t next_prime(uint32_t n)
+{
+	if (n <= 2)
+		return 2;
 
-	while (std::getline(wif, current_word))
+	for (n |= 1;; n += 2)
 	{
-#ifdef DEBUG
-		std::wcerr << L"Inserting " << current_word << L"\n";
-#endif
+		auto is_prime = true;
 
-		if (current_word.back() == '\r')
-			current_word.pop_back();
+		for (uint32_t i = 3; static_cast<uint64_t>(i) * i <= n; i += 2)
+		{
+			if (n % i == 0)
+			{
+				is_prime = false;
+				break;
+			}
+		}
 
-		wm.insert(std::move(current_word), i);
-		i++;
+		if (is_prime)
+			return n;
 	}
+}
 
-	wif.close();
+/**
+ * Hash and displace - buckets are placed from the largest one, each bucket gets the first displacement
+ * that moves all of its words into free slots
+ *
+ * @return False if some bucket could not be placed, the caller should retry with another seed
+ */
+static bool build_perfect_hash(const std::wstring& pool, const std::vector<uint32_t>& word_offsets,
+                               const dictionary_file_header& header, std::vector<uint32_t>& displacements,
+                               std::vector<uint32_t>& slots)
+{
+	const auto word_at = [&](const uint32_t number)
+	{
+		return std::wstring_view(pool.data() + word_offsets[number], word_offsets[number + 1] - word_offsets[number]);
+	};
+
+	std::vector<perfect_hash> hashes;
+	std::vector<std::vector<uint32_t>> buckets(header.bucket_count);
+
+	hashes.reserve(header.word_count + 1);
+	hashes.emplace_back(0, header.bucket_count, header.slot_count);
+
+	for (uint32_t number = 1; number <= header.word_count; number++)
+	{
+		const auto word = word_at(number);
+
+		hashes.emplace_back(hash_word(word, header.seed), header.bucket_count, header.slot_count);
+
+		if (word.empty())
+			continue;
+
+		auto& bucket = buckets[hashes.back().bucket];
+
+		// Duplicate words keep the int code of their first occurrence
+		if (std::none_of(bucket.begin(), bucket.end(), [&](const uint32_t other) { return word_at(other) == word; }))
+			bucket.push_back(number);
+	}
+
+	std::vector<uint32_t> order(header.bucket_count);
+
+	for (uint32_t i = 0; i < header.bucket_count; i++)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b)
+	{
+		return buckets[a].size() > buckets[b].size();
+	});
+
+	displacements.assign(header.bucket_count, 0);
+	slots.assign(header.slot_count, 0);
+
+	std::vector<uint64_t> bucket_slots;
+
+	for (auto bucket_index : order)
+	{
+		const auto& bucket = buckets[bucket_index];
+
+		if (bucket.empty())
+			break;
+
+		auto placed = false;
+
+		const auto max_displacement = std::min<uint64_t>(static_cast<uint64_t>(header.slot_count) * 64, UINT32_MAX);
+
+		for (uint64_t displacement = 0; displacement < max_displacement && !placed; displacement++)
+		{
+			bucket_slots.clear();
+			placed = true;
+
+			for (auto number : bucket)
+			{
+				const auto slot = hashes[number].slot(static_cast<uint32_t>(displacement), header.slot_count);
+
+				if (slots[slot] != 0 || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end())
+				{
+					placed = false;
+					break;
+				}
+
+				bucket_slots.push_back(slot);
+			}
+
+			if (placed)
+			{
+				for (size_t i = 0; i < bucket.size(); i++)
+					slots[bucket_slots[i]] = bucket[i];
+
+				displacements[bucket_index] = static_cast<uint32_t>(displacement);
+			}
+		}
+
+		if (!placed)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Fills the slots of an open addressing table (linear probing, the slot count is a power of two)
+ */
+static void build_open_addressing(const std::wstring& pool, const std::vector<uint32_t>& word_offsets,
+                                  const dictionary_file_header& header, std::vector<uint32_t>& slots)
+{
+	const auto word_at = [&](const uint32_t number)
+	{
+		return std::wstring_view(pool.data() + word_offsets[number], word_offsets[number + 1] - word_offsets[number]);
+	};
+
+	const auto mask = header.slot_count - 1;
+
+	slots.assign(header.slot_count, 0);
+
+	for (uint32_t number = 1; number <= header.word_count; number++)
+	{
+		const auto word = word_at(number);
+
+		if (word.empty())
+			continue;
+
+		auto slot = hash_word(word, header.seed) & mask;
+
+		// Duplicate words keep the int code of their first occurrence
+		while (slots[slot] != 0 && word_at(slots[slot]) != word)
+			slot = (slot + 1) & mask;
+
+		if (slots[slot] == 0)
+			slots[slot] = number;
+	}
+}
+
+/**
+ * Builds the binary dictionary image out of the text dictionary\n
+ * The int code of every word is its line number, see dictionary_file_header for the layout of the image
+ *
+ * @param filename Path to the text dictionary file (UTF-8, one word per line)
+ * @param perfect Builds the perfect hash if true (slower, meant for images that are saved),
+ *                a cheaper open addressing table with load factor of at most 0.5 otherwise
+ * @return The image, ready to be dumped into a file or used by a word_mapping object directly
+ */
+std::vector<char> build_dictionary_image(const std::string& filename, const bool perfect)
+{
+	const auto text = mem_map(filename);
+
+	// Empty files are not mapped, a file that cannot be mapped is read instead
+	std::string contents;
+
+	if (!text)
+	{
+		std::ifstream file(filename, std::ios::binary);
+
+		if (!file)
+			throw_error(errors::dictionary_error);
+
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+		if (file.bad())
+			throw_error(errors::dictionary_error);
+	}
+
+	// The text is decoded straight into the pool, no string is allocated per word
+	std::wstring pool;
+	std::vector<uint32_t> word_offsets{0, 0};
+
+	auto line = text ? std::string_view(text.data(), text.size()) : std::string_view(contents);
+
+	if (line.substr(0, 3) == "\xEF\xBB\xBF")
+		line.remove_prefix(3);
+
+	while (!line.empty())
+	{
+		const auto line_end = std::min(line.find('\n'), line.size());
+		auto word = line.substr(0, line_end);
+
+		if (!word.empty() && word.back() == '\r')
+			word.remove_suffix(1);
+
+		append_utf8(pool, word);
+		word_offsets.push_back(static_cast<uint32_t>(pool.size()));
+
+		line.remove_prefix(std::min(line_end + 1, line.size()));
+	}
+
+	dictionary_file_header header{};
+	memcpy(header.magic, dictionary_file_magic, sizeof dictionary_file_magic);
+	header.char_size = sizeof(wchar_t);
+	header.word_count = static_cast<uint32_t>(word_offsets.size() - 2);
+	header.pool_length = static_cast<uint32_t>(pool.size());
+	header.seed = 1;
+
+	std::vector<uint32_t> displacements, slots;
+
+	if (perfect)
+	{
+		header.bucket_count = std::max<uint32_t>(1, header.word_count / 4);
+		header.slot_count = next_prime(header.word_count + header.word_count / 50);
+
+		while (!build_perfect_hash(pool, word_offsets, header, displacements, slots))
+			header.seed++;
+	}
+	else
+	{
+		header.bucket_count = 0;
+		header.slot_count = 2;
+
+		while (header.slot_count < 2 * header.word_count)
+			header.slot_count *= 2;
+
+		build_open_addressing(pool, word_offsets, header, slots);
+	}
+
+	std::vector<char> image;
+
+	const auto append = [&image](const void* data, const size_t size)
+	{
+		image.insert(image.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+	};
+
+	image.reserve(sizeof header + (word_offsets.size() + displacements.size() + slots.size()) * sizeof(uint32_t) +
+		pool.size() * sizeof(wchar_t));
+
+	append(&header, sizeof header);
+	append(word_offsets.data(), word_offsets.size() * sizeof(uint32_t));
+	append(displacements.data(), displacements.size() * sizeof(uint32_t));
+	append(slots.data(), slots.size() * sizeof(uint32_t));
+	append(pool.data(), pool.size() * sizeof(wchar_t));
+
+	return image;
+}
+
+/**
+ * Builds the binary dictionary image and dumps it into a file so that it can be memory mapped on startup
+ *
+ * @param text_filename Path to the text dictionary file
+ * @param binary_filename Path, to which the image will be dumped
+ */
+void save_dictionary_image(const std::string& text_filename, const std::string& binary_filename)
+{
+	const auto image = build_dictionary_image(text_filename, true);
+
+	std::ofstream ofs(binary_filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	ofs.write(image.data(), image.size());
+	ofs.close();
+}
+
+/**
+ * Maps the binary dictionary image if it is present and valid, otherwise builds the image from the text dictionary
+ *
+ * @param binary_filename Path to the binary dictionary image (see save_dictionary_image)
+ * @param text_filename Path to the text dictionary file
+ * @return Bimap of the dictionary
+ */
+word_mapping load_dictionary(const std::string& binary_filename, const std::string& text_filename)
+{
+	auto wm = word_mapping(mem_map(binary_filename));
+
+	if (!wm.empty())
+		return wm;
+
+	return word_mapping(build_dictionary_image(text_filename, false));
+}
+
+/**
+ * Converts the raw model into the delta and varint compressed format (see varint_trigram_model)\n
+ * Records of every block are sorted by (first_w, third_w) before they are encoded
+ *
+ * @param raw_filename Path to the raw model file
+ * @param ot Offset table of the raw model
+ * @param varint_filename Path, to which the compressed model will be dumped
+ */
+void convert_model_to_varint(const std::string& raw_filename, const offset_table& ot, const std::string& varint_filename)
+{
+	const auto raw = mem_map(raw_filename);
+
+	if (!raw)
+		throw_error(errors::model_error);
+
+	std::ofstream ofs(varint_filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	model_file_header header{};
+	memcpy(header.magic, varint_model_magic, sizeof varint_model_magic);
+	header.entry_count = static_cast<uint32_t>(ot.size());
+	header.flags = model_flag_sorted;
+
+	// The index is written twice - as a placeholder now and with the actual positions once all blocks are known
+	std::vector<block_index_entry> index(header.entry_count, block_index_entry{});
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(block_index_entry));
+
+	uint64_t offset = sizeof header + index.size() * sizeof(block_index_entry);
+
+	std::vector<model_record> records;
+	std::vector<uint8_t> encoded;
+
+	for (uint32_t key = 1; key < header.entry_count; key++)
+	{
+		const auto block = ot.get_block(static_cast<int>(key));
+		const auto span = mmap_binary_reader(raw).read_block(block.offset, block.length, records);
+
+		records.assign(span.begin(), span.end());
+		sort_block_records(records);
+
+		encoded.clear();
+		encode_varint_block(records, encoded);
+
+		index[key] = block_index_entry{offset, static_cast<uint32_t>(records.size()), static_cast<uint32_t>(encoded.size())};
+
+		ofs.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+		offset += encoded.size();
+	}
+
+	ofs.seekp(sizeof header, std::ios::beg);
+	ofs.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(block_index_entry));
+
+	ofs.close();
+}
+
+/**
+ * Converts the raw model into the struct-of-arrays format (see columnar_trigram_model)\n
+ * Records of every block are sorted by (first_w, third_w), blocks of at least 'fence_threshold' records
+ * are followed by their fence pointers
+ *
+ * @param raw_filename Path to the raw model file
+ * @param ot Offset table of the raw model
+ * @param columnar_filename Path, to which the converted model will be dumped
+ */
+void convert_model_to_columnar(const std::string& raw_filename, const offset_table& ot,
+                               const std::string& columnar_filename)
+{
+	const auto raw = mem_map(raw_filename);
+
+	if (!raw)
+		throw_error(errors::model_error);
+
+	std::ofstream ofs(columnar_filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	model_file_header header{};
+	memcpy(header.magic, columnar_model_magic, sizeof columnar_model_magic);
+	header.entry_count = static_cast<uint32_t>(ot.size());
+	header.flags = model_flag_sorted;
+
+	std::vector<block_index_entry> index(header.entry_count, block_index_entry{});
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(block_index_entry));
+
+	uint64_t offset = sizeof header + index.size() * sizeof(block_index_entry);
+
+	std::vector<model_record> records;
+	std::vector<int32_t> columns;
+
+	for (uint32_t key = 1; key < header.entry_count; key++)
+	{
+		const auto block = ot.get_block(static_cast<int>(key));
+		const auto span = mmap_binary_reader(raw).read_block(block.offset, block.length, records);
+		const auto length = span.size();
+
+		records.assign(span.begin(), span.end());
+		sort_block_records(records);
+
+		columns.resize(3 * length);
+
+		for (size_t i = 0; i < length; i++)
+		{
+			columns[i] = records[i].first_w;
+			columns[length + i] = records[i].third_w;
+			columns[2 * length + i] = records[i].count;
+		}
+
+		if (length >= fence_threshold)
+			for (size_t i = 0; i < length; i += fence_interval)
+				columns.push_back(records[i].first_w);
+
+		const auto size = columns.size() * sizeof(int32_t);
+
+		index[key] = block_index_entry{offset, static_cast<uint32_t>(length), static_cast<uint32_t>(size)};
+
+		ofs.write(reinterpret_cast<const char*>(columns.data()), size);
+		offset += size;
+	}
+
+	ofs.seekp(sizeof header, std::ios::beg);
+	ofs.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(block_index_entry));
+
+	ofs.close();
+}
+
+/**
+ * Precomputes the unigram and bigram counts of every middle word from its trigram block (see count_tables)
+ *
+ * @param model The installed trigram model in any format
+ * @param word_count Number of words in the dictionary
+ * @param filename Path, to which the tables will be dumped
+ */
+void save_count_tables(const trigram_model& model, const size_t word_count, const std::string& filename)
+{
+	std::vector<int32_t> unigrams(word_count + 1, 0);
+	std::vector<uint32_t> bigram_offsets(word_count + 2, 0);
+	std::vector<int32_t> bigram_first, bigram_counts;
+
+	std::vector<model_record> buffer;
+	std::vector<std::pair<int32_t, int32_t>> pairs;
+
+	for (size_t key = 1; key <= word_count; key++)
+	{
+		const auto block = model.read_block(static_cast<int>(key), buffer);
+
+		bigram_offsets[key] = static_cast<uint32_t>(bigram_first.size());
+
+		uint32_t sum = 0;
+		pairs.clear();
+
+		for (size_t i = 0; i < block.size(); i++)
+		{
+			sum += static_cast<uint32_t>(block.count(i));
+			pairs.emplace_back(block.first(i), block.count(i));
+		}
+
+		unigrams[key] = static_cast<int32_t>(sum);
+
+		// Sorted by the preceding word and by the count, the last pair of every preceding word has the highest count
+		std::sort(pairs.begin(), pairs.end());
+
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			if (i + 1 < pairs.size() && pairs[i + 1].first == pairs[i].first)
+				continue;
+
+			bigram_first.push_back(pairs[i].first);
+			bigram_counts.push_back(pairs[i].second);
+		}
+	}
+
+	bigram_offsets[word_count + 1] = static_cast<uint32_t>(bigram_first.size());
+
+	std::ofstream ofs(filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	count_tables_header header{};
+	memcpy(header.magic, count_tables_magic, sizeof count_tables_magic);
+	header.word_count = static_cast<uint32_t>(word_count);
+	header.bigram_count = static_cast<uint32_t>(bigram_first.size());
+	header.model_fingerprint = model_fingerprint(model, word_count);
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(unigrams.data()), unigrams.size() * sizeof(int32_t));
+	ofs.write(reinterpret_cast<const char*>(bigram_offsets.data()), bigram_offsets.size() * sizeof(uint32_t));
+	ofs.write(reinterpret_cast<const char*>(bigram_first.data()), bigram_first.size() * sizeof(int32_t));
+	ofs.write(reinterpret_cast<const char*>(bigram_counts.data()), bigram_counts.size() * sizeof(int32_t));
+
+	ofs.close();
+}
+
+/**
+ * Groups the dictionary words by their folded form and builds the folded index image (see folded_index)
+ *
+ * @param wm Bimap of the dictionary
+ * @return The image, it can be dumped into a file and mapped back
+ */
+std::vector<char> build_folded_index(const word_mapping& wm)
+{
+	std::vector<std::pair<std::wstring, int32_t>> words;
+	words.reserve(wm.size());
+
+	for (size_t id = 1; id <= wm.size(); id++)
+	{
+		const auto word = wm.int_to_word(static_cast<int>(id));
+
+		// Duplicate words are only reachable through the code word_to_int returns for them
+		if (word.empty() || wm.word_to_int(word) != static_cast<int>(id))
+			continue;
+
+		words.emplace_back(std::wstring(word), static_cast<int32_t>(id));
+	}
+
+	std::vector<std::wstring> folded(words.size());
+
+	for (size_t i = 0; i < words.size(); i++)
+	{
+		folded[i] = words[i].first;
+
+		for (auto& c : folded[i])
+			c = fold_letter(c);
+	}
+
+	// Ordered by the folded form first and by the word itself second, the same order get_variants produces
+	std::vector<size_t> order(words.size());
+
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b)
+	{
+		if (folded[a] != folded[b])
+			return folded[a] < folded[b];
+		return words[a].first < words[b].first;
+	});
+
+	std::vector<folded_key> keys;
+	std::vector<int32_t> ids;
+	std::vector<size_t> key_words;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		if (i == 0 || folded[order[i]] != folded[order[i - 1]])
+		{
+			keys.push_back(folded_key{static_cast<uint32_t>(ids.size()), 0});
+			key_words.push_back(order[i]);
+		}
+
+		keys.back().length++;
+		ids.push_back(words[order[i]].second);
+	}
+
+	uint32_t slot_count = 1;
+
+	while (slot_count < 2 * keys.size() + 1)
+		slot_count <<= 1;
+
+	std::vector<uint32_t> slots(slot_count, 0);
+	const auto mask = slot_count - 1;
+
+	for (size_t k = 0; k < keys.size(); k++)
+	{
+		auto slot = hash_word(folded[key_words[k]], 0) & mask;
+
+		while (slots[slot] != 0)
+			slot = (slot + 1) & mask;
+
+		slots[slot] = static_cast<uint32_t>(k + 1);
+	}
+
+	folded_index_header header{};
+	memcpy(header.magic, folded_index_magic, sizeof folded_index_magic);
+	header.word_count = static_cast<uint32_t>(wm.size());
+	header.key_count = static_cast<uint32_t>(keys.size());
+	header.slot_count = slot_count;
+	header.id_count = static_cast<uint32_t>(ids.size());
+
+	std::vector<char> image(sizeof header + keys.size() * sizeof(folded_key) + slots.size() * sizeof(uint32_t) +
+		ids.size() * sizeof(int32_t));
+
+	auto section = image.data();
+
+	memcpy(section, &header, sizeof header);
+	section += sizeof header;
+	memcpy(section, keys.data(), keys.size() * sizeof(folded_key));
+	section += keys.size() * sizeof(folded_key);
+	memcpy(section, slots.data(), slots.size() * sizeof(uint32_t));
+	section += slots.size() * sizeof(uint32_t);
+	memcpy(section, ids.data(), ids.size() * sizeof(int32_t));
+
+	return image;
+}
+
+/**
+ * Builds the folded index of the dictionary and dumps it into a file so that it can be memory mapped on startup
+ *
+ * @param wm Bimap of the dictionary
+ * @param filename Path, to which the index will be dumped
+ */
+void save_folded_index(const word_mapping& wm, const std::string& filename)
+{
+	const auto image = build_folded_index(wm);
+
+	std::ofstream ofs(filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	ofs.write(image.data(), image.size());
+	ofs.close();
+}
+
+/**
+ * Maps the folded index if it is present and matches the dictionary, otherwise builds it in memory
+ *
+ * @param binary_filename Path to the folded index (see save_folded_index)
+ * @param wm Bimap of the dictionary
+ */
+folded_index load_folded_index(const std::string& binary_filename, const word_mapping& wm)
+{
+	auto fi = folded_index(mem_map(binary_filename), wm.size());
+
+	if (!fi.empty())
+		return fi;
+
+	return folded_index(build_folded_index(wm), wm.size());
+}
+
+/**
+ * Builds the minimized automaton of the dictionary (see dawg_dictionary) from its words in lexicographic order,
+ * every finished branch is merged with an equivalent node registered before, if there is one
+ *
+ * @param wm Bimap of the dictionary
+ * @return The image, it can be dumped into a file and mapped back
+ */
+std::vector<char> build_dawg_image(const word_mapping& wm)
+{
+	std::vector<std::pair<std::wstring_view, int32_t>> words;
+	words.reserve(wm.size());
+
+	for (size_t id = 1; id <= wm.size(); id++)
+	{
+		const auto word = wm.int_to_word(static_cast<int>(id));
+
+		// Duplicate words are only reachable through the code word_to_int returns for them
+		if (word.empty() || wm.word_to_int(word) != static_cast<int>(id))
+			continue;
+
+		words.emplace_back(word, static_cast<int32_t>(id));
+	}
+
+	std::sort(words.begin(), words.end());
+
+	struct builder_node
+	{
+		bool final = false;
+		uint32_t words = 0;
+		std::vector<std::pair<uint32_t, uint32_t>> edges;
+	};
+
+	// The children of a node are complete by the time the node itself is minimized
+	const auto count_words = [](std::vector<builder_node>& all, const uint32_t n)
+	{
+		all[n].words = all[n].final ? 1 : 0;
+
+		for (const auto& edge : all[n].edges)
+			all[n].words += all[edge.second].words;
+	};
+
+	std::vector<builder_node> nodes(1);
+	std::map<std::vector<uint32_t>, uint32_t> registered;
+	std::vector<uint32_t> unchecked;
+	std::vector<uint32_t> signature;
+
+	// Replaces the nodes of the previous word below the common prefix with their registered equivalents
+	const auto minimize = [&](const size_t down_to)
+	{
+		while (unchecked.size() > down_to)
+		{
+			const auto child = unchecked.back();
+			unchecked.pop_back();
+
+			const auto parent = unchecked.empty() ? 0 : unchecked.back();
+
+			count_words(nodes, child);
+			signature.assign(1, nodes[child].final);
+
+			for (const auto& edge : nodes[child].edges)
+			{
+				signature.push_back(edge.first);
+				signature.push_back(edge.second);
+			}
+
+			const auto it = registered.find(signature);
+
+			if (it != registered.end())
+				nodes[parent].edges.back().second = it->second;
+			else
+				registered.emplace(signature, child);
+		}
+	};
+
+	std::wstring_view previous;
+
+	for (const auto& word : words)
+	{
+		size_t common = 0;
+
+		while (common < word.first.size() && common < previous.size() && word.first[common] == previous[common])
+			common++;
+
+		minimize(common);
+
+		auto node = unchecked.empty() ? 0 : unchecked.back();
+
+		for (auto i = common; i < word.first.size(); i++)
+		{
+			nodes.emplace_back();
+			nodes[node].edges.emplace_back(static_cast<uint32_t>(word.first[i]), static_cast<uint32_t>(nodes.size() - 1));
+			node = static_cast<uint32_t>(nodes.size() - 1);
+			unchecked.push_back(node);
+		}
+
+		nodes[node].final = true;
+		previous = word.first;
+	}
+
+	minimize(0);
+	count_words(nodes, 0);
+
+	// Renumbers the nodes reachable from the root, merged nodes are left behind
+	std::vector<uint32_t> number(nodes.size(), UINT32_MAX);
+	std::vector<uint32_t> order{0};
+	number[0] = 0;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		for (const auto& edge : nodes[order[i]].edges)
+		{
+			if (number[edge.second] == UINT32_MAX)
+			{
+				number[edge.second] = static_cast<uint32_t>(order.size());
+				order.push_back(edge.second);
+			}
+		}
+	}
+
+	std::vector<dawg_node> packed_nodes(order.size());
+	std::vector<dawg_edge> packed_edges;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const auto& node = nodes[order[i]];
+		auto before = node.final ? 1u : 0u;
+
+		packed_nodes[i] = dawg_node{
+			static_cast<uint32_t>(packed_edges.size()),
+			static_cast<uint32_t>(node.edges.size()) | (node.final ? dawg_final_flag : 0),
+			node.words
+		};
+
+		for (const auto& edge : node.edges)
+		{
+			packed_edges.push_back(dawg_edge{edge.first, number[edge.second], before});
+			before += nodes[edge.second].words;
+		}
+	}
+
+	// Words were inserted in lexicographic order, their ranks are their positions
+	std::vector<int32_t> rank_to_id(words.size());
+	std::vector<uint32_t> id_to_rank(wm.size() + 1, dawg_no_rank);
+
+	for (size_t rank = 0; rank < words.size(); rank++)
+		rank_to_id[rank] = words[rank].second;
+
+	for (size_t id = 1; id <= wm.size(); id++)
+	{
+		const auto word = wm.int_to_word(static_cast<int>(id));
+		const auto canonical = std::lower_bound(words.begin(), words.end(), std::make_pair(word, INT32_MIN));
+
+		if (canonical != words.end() && canonical->first == word)
+			id_to_rank[id] = static_cast<uint32_t>(canonical - words.begin());
+	}
+
+	dawg_file_header header{};
+	memcpy(header.magic, dawg_file_magic, sizeof dawg_file_magic);
+	header.word_count = static_cast<uint32_t>(wm.size());
+	header.key_count = static_cast<uint32_t>(words.size());
+	header.node_count = static_cast<uint32_t>(packed_nodes.size());
+	header.edge_count = static_cast<uint32_t>(packed_edges.size());
+
+	std::vector<char> image(sizeof header + packed_nodes.size() * sizeof(dawg_node) +
+		packed_edges.size() * sizeof(dawg_edge) + rank_to_id.size() * sizeof(int32_t) +
+		id_to_rank.size() * sizeof(uint32_t));
+
+	auto section = image.data();
+
+	memcpy(section, &header, sizeof header);
+	section += sizeof header;
+	memcpy(section, packed_nodes.data(), packed_nodes.size() * sizeof(dawg_node));
+	section += packed_nodes.size() * sizeof(dawg_node);
+	memcpy(section, packed_edges.data(), packed_edges.size() * sizeof(dawg_edge));
+	section += packed_edges.size() * sizeof(dawg_edge);
+	memcpy(section, rank_to_id.data(), rank_to_id.size() * sizeof(int32_t));
+	section += rank_to_id.size() * sizeof(int32_t);
+	memcpy(section, id_to_rank.data(), id_to_rank.size() * sizeof(uint32_t));
+
+	return image;
+}
+
+/**
+ * Builds the dictionary automaton and dumps it into a file so that it can be memory mapped on startup
+ *
+ * @param wm Bimap of the dictionary
+ * @param filename Path, to which the automaton will be dumped
+ */
+void save_dawg_dictionary(const word_mapping& wm, const std::string& filename)
+{
+	const auto image = build_dawg_image(wm);
+
+	std::ofstream ofs(filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	ofs.write(image.data(), image.size());
+	ofs.close();
+}
+
+/**
+ * Maps the dictionary automaton if it is present and matches the dictionary, otherwise builds it in memory
+ *
+ * @param binary_filename Path to the automaton (see save_dawg_dictionary)
+ * @param wm Bimap of the dictionary
+ */
+dawg_dictionary load_dawg_dictionary(const std::string& binary_filename, const word_mapping& wm)
+{
+	auto dawg = dawg_dictionary(mem_map(binary_filename), wm.size());
+
+	if (!dawg.empty())
+		return dawg;
+
+	return dawg_dictionary(build_dawg_image(wm), wm.size());
+}
+
+/**
+ * Compiles the decision tables (see decision_tables) - every triplet of the model is folded and competes for its
+ * folded trigram and folded bigram with the other triplets, ties are broken exactly as the full search breaks them
+ * (the variant that comes first in the order of the words wins)
+ *
+ * @param model The installed trigram model in any format
+ * @param wm Bimap of the dictionary
+ * @param fi Folded index of the dictionary, the tables refer to its key numbers
+ * @param filename Path, to which the tables will be dumped
+ */
+void save_decision_tables(const trigram_model& model, const word_mapping& wm, const folded_index& fi,
+                          const std::string& filename)
+{
+	const auto key_count = static_cast<uint32_t>(fi.key_count());
+
+	// Folded form of every word and its position among the words of the same form
+	std::vector<uint32_t> id_key(wm.size() + 1, UINT32_MAX), id_rank(wm.size() + 1, 0);
+
+	for (uint32_t key = 0; key < key_count; key++)
+	{
+		uint32_t length;
+		const auto ids = fi.key_ids(key, length);
+
+		for (uint32_t i = 0; i < length; i++)
+		{
+			id_key[ids[i]] = key;
+			id_rank[ids[i]] = i;
+		}
+	}
+
+	const auto folded = [&](const int32_t id)
+	{
+		return id > 0 && static_cast<size_t>(id) <= wm.size() ? id_key[id] : UINT32_MAX;
+	};
+
+	struct folded_trigram
+	{
+		uint32_t left, middle, right;
+
+		bool operator==(const folded_trigram& other) const
+		{
+			return left == other.left && middle == other.middle && right == other.right;
+		}
+	};
+
+	struct folded_trigram_hash
+	{
+		size_t operator()(const folded_trigram& key) const
+		{
+			return static_cast<size_t>(hash_folded_keys(key.left, key.middle, key.right));
+		}
+	};
+
+	struct trigram_candidate
+	{
+		int32_t count, winner, runner_up;
+	};
+
+	struct bigram_candidate
+	{
+		int32_t count, left_winner, right_winner, right_context;
+	};
+
+	std::unordered_map<folded_trigram, trigram_candidate, folded_trigram_hash> trigrams;
+	std::unordered_map<uint64_t, bigram_candidate> bigrams;
+	std::vector<int32_t> unigrams(wm.size() + 1, 0);
+	std::vector<model_record> buffer;
+
+	for (size_t second_w = 1; second_w <= wm.size(); second_w++)
+	{
+		const auto block = model.read_block(static_cast<int>(second_w), buffer);
+		const auto middle = folded(static_cast<int32_t>(second_w));
+		const auto second = static_cast<int32_t>(second_w);
+
+		uint32_t sum = 0;
+
+		for (size_t i = 0; i < block.size(); i++)
+			sum += static_cast<uint32_t>(block.count(i));
+
+		unigrams[second_w] = static_cast<int32_t>(sum);
+
+		if (middle == UINT32_MAX)
+			continue;
+
+		for (size_t i = 0; i < block.size(); i++)
+		{
+			const auto first = block.first(i), count = block.count(i);
+			const auto left = folded(first), right = folded(block.third(i));
+
+			if (left == UINT32_MAX)
+				continue;
+
+			// The preceding word is the variant to pick when the middle word of the record follows the word in question
+			const auto pair = bigrams.try_emplace(static_cast<uint64_t>(left) << 32 | middle,
+			                                      bigram_candidate{count, second, first, second});
+
+			if (!pair.second)
+			{
+				auto& candidate = pair.first->second;
+
+				if (count > candidate.count)
+					candidate = bigram_candidate{count, second, first, second};
+				else if (count == candidate.count)
+				{
+					if (id_rank[second] < id_rank[candidate.left_winner])
+						candidate.left_winner = second;
+
+					if (id_rank[second] < id_rank[candidate.right_context] ||
+						(second == candidate.right_context && id_rank[first] < id_rank[candidate.right_winner]))
+					{
+						candidate.right_winner = first;
+						candidate.right_context = second;
+					}
+				}
+			}
+
+			if (right == UINT32_MAX)
+				continue;
+
+			const auto triplet = trigrams.try_emplace(folded_trigram{left, middle, right},
+			                                          trigram_candidate{count, second, 0});
+
+			if (triplet.second)
+				continue;
+
+			auto& candidate = triplet.first->second;
+
+			if (count > candidate.count || (count == candidate.count && id_rank[second] < id_rank[candidate.winner]))
+			{
+				if (second != candidate.winner)
+					candidate.runner_up = std::max(candidate.runner_up, candidate.count);
+
+				candidate.count = count;
+				candidate.winner = second;
+			}
+			else if (second != candidate.winner)
+				candidate.runner_up = std::max(candidate.runner_up, count);
+		}
+	}
+
+	std::vector<int32_t> unigram_winners(key_count, 0);
+
+	for (uint32_t key = 0; key < key_count; key++)
+	{
+		uint32_t length;
+		const auto ids = fi.key_ids(key, length);
+
+		// The first variant wins unless another one has a higher positive count, as in resolve_word
+		auto best = 0;
+		unigram_winners[key] = ids[0];
+
+		for (uint32_t i = 0; i < length; i++)
+		{
+			if (unigrams[ids[i]] > best)
+			{
+				best = unigrams[ids[i]];
+				unigram_winners[key] = ids[i];
+			}
+		}
+	}
+
+	uint32_t trigram_slots = 1, bigram_slots = 1;
+
+	while (trigram_slots < 2 * trigrams.size() + 1)
+		trigram_slots <<= 1;
+	while (bigram_slots < 2 * bigrams.size() + 1)
+		bigram_slots <<= 1;
+
+	std::vector<trigram_decision> trigram_table(trigram_slots, trigram_decision{});
+	std::vector<bigram_decision> bigram_table(bigram_slots, bigram_decision{});
+
+	for (const auto& [key, candidate] : trigrams)
+	{
+		auto slot = hash_folded_keys(key.left, key.middle, key.right) & (trigram_slots - 1);
+
+		while (trigram_table[slot].winner != 0)
+			slot = (slot + 1) & (trigram_slots - 1);
+
+		trigram_table[slot] = trigram_decision{
+			key.left, key.middle, key.right, candidate.winner, candidate.count - candidate.runner_up
+		};
+	}
+
+	for (const auto& [key, candidate] : bigrams)
+	{
+		const auto first = static_cast<uint32_t>(key >> 32), second = static_cast<uint32_t>(key);
+		auto slot = hash_folded_keys(first, second) & (bigram_slots - 1);
+
+		while (bigram_table[slot].left_winner != 0)
+			slot = (slot + 1) & (bigram_slots - 1);
+
+		bigram_table[slot] = bigram_decision{
+			first, second, candidate.left_winner, candidate.right_winner, candidate.count
+		};
+	}
+
+	std::ofstream ofs(filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	decision_tables_header header{};
+	memcpy(header.magic, decision_tables_magic, sizeof decision_tables_magic);
+	header.word_count = static_cast<uint32_t>(wm.size());
+	header.key_count = key_count;
+	header.trigram_slots = trigram_slots;
+	header.bigram_slots = bigram_slots;
+	header.model_fingerprint = model_fingerprint(model, wm.size());
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(unigram_winners.data()), unigram_winners.size() * sizeof(int32_t));
+	ofs.write(reinterpret_cast<const char*>(trigram_table.data()), trigram_table.size() * sizeof(trigram_decision));
+	ofs.write(reinterpret_cast<const char*>(bigram_table.data()), bigram_table.size() * sizeof(bigram_decision));
+
+	ofs.close();
+}
+
+/**
+ * Builds the context filter (see bloom_filter) over all triplets of the model and the pairs they start with
+ *
+ * @param model The installed trigram model in any format
+ * @param word_count Number of words in the dictionary
+ * @param filename Path, to which the filter will be dumped
+ */
+void save_bloom_filter(const trigram_model& model, const size_t word_count, const std::string& filename)
+{
+	std::vector<model_record> buffer;
+	size_t record_count = 0;
+
+	for (size_t key = 1; key <= word_count; key++)
+		record_count += model.read_block(static_cast<int>(key), buffer).size();
+
+	// Every record adds its triplet and at most one new pair
+	const auto bits = 2 * record_count * bloom_bits_per_key;
+	uint32_t block_count = 1;
+
+	while (static_cast<size_t>(block_count) * bloom_block_words * 64 < bits && block_count < (1u << 31))
+		block_count <<= 1;
+
+	std::vector<uint64_t> blocks(static_cast<size_t>(block_count) * bloom_block_words, 0);
+
+	const auto add = [&](const uint64_t hash)
+	{
+		const auto block = blocks.data() + bloom_filter::block_of(hash, block_count);
+
+		bloom_filter::for_each_bit(hash, [&](const uint32_t word, const uint64_t mask)
+		{
+			block[word] |= mask;
+		});
+	};
+
+	for (size_t key = 1; key <= word_count; key++)
+	{
+		const auto block = model.read_block(static_cast<int>(key), buffer);
+		const auto second_w = static_cast<int32_t>(key);
+
+		for (size_t i = 0; i < block.size(); i++)
+		{
+			add(bloom_filter::hash_context(block.first(i), second_w, block.third(i)));
+			add(bloom_filter::hash_context(block.first(i), second_w));
+		}
+	}
+
+	std::ofstream ofs(filename, std::ios::binary);
+
+	if (!ofs)
+		throw_error(errors::output_file_error);
+
+	bloom_filter_header header{};
+	memcpy(header.magic, bloom_filter_magic, sizeof bloom_filter_magic);
+	header.word_count = static_cast<uint32_t>(word_count);
+	header.block_count = block_count;
+	header.model_fingerprint = model_fingerprint(model, word_count);
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(uint64_t));
+
+	ofs.close();
+}
+
+/**
+ * Opens the trigram model in the requested format\n
+ * The automatic format prefers the columnar model, then the compressed one and falls back to the raw one
+ */
+std::unique_ptr<trigram_model> load_model(const model_format format)
+{
+	if (format == model_format::columnar || format == model_format::automatic)
+	{
+		auto model = std::make_unique<columnar_trigram_model>(columnar_model_name);
+
+		if (*model)
+			return model;
+
+		if (format == model_format::columnar)
+			throw_error(errors::model_error);
+	}
+
+	if (format == model_format::varint || format == model_format::automatic)
+	{
+		auto model = std::make_unique<varint_trigram_model>(varint_model_name);
+
+		if (*model)
+			return model;
+
+		if (format == model_format::varint)
+			throw_error(errors::model_error);
+	}
+
+	if (!std::ifstream(model_name, std::ios::binary))
+		throw_error(errors::model_error);
 
-	return wm;
+	return std::make_unique<raw_trigram_model>(model_name, load_offset_table(binary_offset_model_name, offset_model_name));
 }
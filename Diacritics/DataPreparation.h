@@ -1,6 +1,11 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <memory>
 #include "LookupStructures.h"
+#include "TrigramModel.h"
+#include "FoldedIndex.h"
+#include "DawgDictionary.h"
 
 void merge_dictionaries(const std::string&, const std::string&);
 
@@ -10,7 +15,39 @@ mutable_offset_table generate_compressed_model(const std::string&);
 
 mutable_offset_table load_compressed_model(const std::string& filename);
 
-mutable_word_mapping load_word_mapping(const std::string& filename);
+void save_binary_offsets(const mutable_offset_table&, const std::string&);
+
+offset_table load_offset_table(const std::string&, const std::string&);
+
+std::vector<char> build_dictionary_image(const std::string&, bool);
+
+void save_dictionary_image(const std::string&, const std::string&);
+
+word_mapping load_dictionary(const std::string&, const std::string&);
+
+void convert_model_to_varint(const std::string&, const offset_table&, const std::string&);
+
+void convert_model_to_columnar(const std::string&, const offset_table&, const std::string&);
+
+std::unique_ptr<trigram_model> load_model(model_format);
+
+void save_count_tables(const trigram_model&, size_t, const std::string&);
+
+std::vector<char> build_folded_index(const word_mapping&);
+
+void save_folded_index(const word_mapping&, const std::string&);
+
+folded_index load_folded_index(const std::string&, const word_mapping&);
+
+std::vector<char> build_dawg_image(const word_mapping&);
+
+void save_dawg_dictionary(const word_mapping&, const std::string&);
+
+dawg_dictionary load_dawg_dictionary(const std::string&, const word_mapping&);
+
+void save_decision_tables(const trigram_model&, const word_mapping&, const folded_index&, const std::string&);
+
+void save_bloom_filter(const trigram_model&, size_t, const std::string&);
 
 // NOT USED - TAKES UP TOO MUCH MEMORY
 void load_trigram_model(const std::string&);
@@ -0,0 +1,330 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ErrorHandler.h"
+#include "MemoryMap.h"
+#include "WideCharUtilities.h"
+
+/**
+ * Dictionary structures the variants of a word are looked up in
+ */
+enum class dictionary_backend
+{
+	hashed,
+	dawg
+};
+
+/**
+ * @return The dictionary backend named on the command line ('hash' or 'dawg')
+ */
+inline dictionary_backend parse_dictionary_backend(const std::string& name)
+{
+	if (name == "hash")
+		return dictionary_backend::hashed;
+	if (name == "dawg")
+		return dictionary_backend::dawg;
+
+	throw_error(errors::invalid_option_error);
+
+	return dictionary_backend::hashed;
+}
+
+/**
+ * Header of the automaton image, the header is followed by these sections:\n
+ * nodes - dawg_node[node_count], the root is the first node\n
+ * edges - dawg_edge[edge_count], the edges of every node are contiguous and ordered by their letter\n
+ * rank_to_id - INT32[key_count], int code of the n-th word in lexicographic order\n
+ * id_to_rank - UINT32[word_count + 1], lexicographic rank of the word with the int code i, dawg_no_rank if
+ * the automaton does not hold it (the empty word)
+ */
+struct dawg_file_header
+{
+	char magic[8];
+	uint32_t word_count;
+	uint32_t key_count;
+	uint32_t node_count;
+	uint32_t edge_count;
+};
+
+/**
+ * Rank of the int codes whose word the automaton does not hold
+ */
+constexpr uint32_t dawg_no_rank = UINT32_MAX;
+
+/**
+ * 'words' is the number of words accepted from the node, the final flag is the highest bit of 'edge_count'
+ */
+struct dawg_node
+{
+	uint32_t first_edge;
+	uint32_t edge_count;
+	uint32_t words;
+};
+
+/**
+ * 'before' is the number of words accepted from the source node that precede the words behind this edge,
+ * so the rank of a word is the sum of 'before' along its path
+ */
+struct dawg_edge
+{
+	uint32_t letter;
+	uint32_t target;
+	uint32_t before;
+};
+
+static const char dawg_file_magic[8] = {'D', 'I', 'A', 'C', 'D', 'W', 'G', '2'};
+
+constexpr uint32_t dawg_final_flag = 0x80000000u;
+
+/**
+ * Dictionary stored as a minimized deterministic acyclic automaton - words sharing prefixes and suffixes share
+ * their nodes\n
+ * Words are numbered by their lexicographic rank while walking the automaton and the rank is translated
+ * to the int code of the word_mapping, the model is indexed by\n
+ * The image is either memory mapped from a prebuilt file or built in memory from the dictionary
+ */
+class dawg_dictionary
+{
+	mem_map mapped_image_;
+	std::vector<char> owned_image_;
+
+	const dawg_file_header* header_ = nullptr;
+	const dawg_node* nodes_ = nullptr;
+	const dawg_edge* edges_ = nullptr;
+	const int32_t* rank_to_id_ = nullptr;
+	const uint32_t* id_to_rank_ = nullptr;
+
+	void attach(const char* image, const size_t size, const size_t word_count)
+	{
+		if (!image || size < sizeof(dawg_file_header))
+			return;
+
+		const auto header = reinterpret_cast<const dawg_file_header*>(image);
+
+		if (memcmp(header->magic, dawg_file_magic, sizeof dawg_file_magic) != 0 ||
+			header->word_count != word_count || header->node_count == 0)
+			return;
+
+		const size_t nodes_size = static_cast<size_t>(header->node_count) * sizeof(dawg_node);
+		const size_t edges_size = static_cast<size_t>(header->edge_count) * sizeof(dawg_edge);
+		const size_t ranks_size = static_cast<size_t>(header->key_count) * sizeof(int32_t);
+		const size_t ids_size = (static_cast<size_t>(header->word_count) + 1) * sizeof(uint32_t);
+
+		if (sizeof(dawg_file_header) + nodes_size + edges_size + ranks_size + ids_size > size)
+			return;
+
+		auto section = image + sizeof(dawg_file_header);
+
+		nodes_ = reinterpret_cast<const dawg_node*>(section);
+		section += nodes_size;
+		edges_ = reinterpret_cast<const dawg_edge*>(section);
+		section += edges_size;
+		rank_to_id_ = reinterpret_cast<const int32_t*>(section);
+		section += ranks_size;
+		id_to_rank_ = reinterpret_cast<const uint32_t*>(section);
+
+		header_ = header;
+	}
+
+	static bool is_final(const dawg_node& node)
+	{
+		return (node.edge_count & dawg_final_flag) != 0;
+	}
+
+	/**
+	 * @return The edge of the node labelled with 'letter', nullptr if the node has none
+	 */
+	const dawg_edge* find_edge(const dawg_node& node, const uint32_t letter) const
+	{
+		const auto first = edges_ + node.first_edge;
+		const auto last = first + (node.edge_count & ~dawg_final_flag);
+
+		const auto it = std::lower_bound(first, last, letter, [](const dawg_edge& edge, const uint32_t l)
+		{
+			return edge.letter < l;
+		});
+
+		return it != last && it->letter == letter ? it : nullptr;
+	}
+
+	/**
+	 * @return The letter itself followed by its variants with diacritics in ascending order, so that walking
+	 * them in this order visits the variant words in lexicographic order
+	 */
+	static const std::wstring& letter_candidates(const wchar_t c)
+	{
+		static const auto table = []
+		{
+			std::array<std::wstring, 128> candidates;
+
+			for (auto letter = 0; letter < 128; letter++)
+			{
+				candidates[letter].push_back(static_cast<wchar_t>(letter));
+
+				if (can_have_diacritics(static_cast<wchar_t>(letter)))
+				{
+					auto variants = get_letter_diacritics(static_cast<wchar_t>(letter));
+					std::sort(variants.begin(), variants.end());
+					candidates[letter] += variants;
+				}
+			}
+
+			return candidates;
+		}();
+
+		thread_local std::wstring single(1, L'\0');
+
+		if (c >= 0 && c < 128)
+			return table[c];
+
+		single[0] = c;
+
+		return single;
+	}
+
+	/**
+	 * Follows the letters of the word from 'position' on, trying every diacritic variant of the letters that can
+	 * have one; a prefix without any continuation in the dictionary is abandoned at once
+	 */
+	void walk_variants(const std::wstring_view word, const size_t position, const uint32_t node, const uint32_t rank,
+	                   std::vector<int32_t>& ids) const
+	{
+		if (position == word.size())
+		{
+			if (is_final(nodes_[node]))
+				ids.push_back(rank_to_id_[rank]);
+
+			return;
+		}
+
+		for (const auto letter : letter_candidates(word[position]))
+		{
+			const auto edge = find_edge(nodes_[node], static_cast<uint32_t>(letter));
+
+			if (edge)
+				walk_variants(word, position + 1, edge->target, rank + edge->before, ids);
+		}
+	}
+
+public:
+	dawg_dictionary() = default;
+
+	/**
+	 * The dictionary stays empty if the image is not valid or was built for a dictionary of another size
+	 */
+	dawg_dictionary(mem_map&& mm, const size_t word_count) : mapped_image_(std::move(mm))
+	{
+		attach(mapped_image_.data(), mapped_image_.size(), word_count);
+	}
+
+	dawg_dictionary(std::vector<char>&& image, const size_t word_count) : owned_image_(std::move(image))
+	{
+		attach(owned_image_.data(), owned_image_.size(), word_count);
+	}
+
+	/**
+	 * @return The int code of the word, 0 if the word is not in the dictionary
+	 */
+	int word_to_int(const std::wstring_view word) const
+	{
+		if (!header_ || word.empty())
+			return 0;
+
+		uint32_t node = 0, rank = 0;
+
+		for (const auto c : word)
+		{
+			const auto edge = find_edge(nodes_[node], static_cast<uint32_t>(c));
+
+			if (!edge)
+				return 0;
+
+			rank += edge->before;
+			node = edge->target;
+		}
+
+		return is_final(nodes_[node]) ? rank_to_id_[rank] : 0;
+	}
+
+	/**
+	 * Spells the word with the int code into 'word'
+	 *
+	 * @return False for unknown int codes and the words the automaton does not hold, 'word' is left empty
+	 */
+	bool int_to_word(const int number, std::wstring& word) const
+	{
+		word.clear();
+
+		if (!header_ || number <= 0 || static_cast<uint32_t>(number) > header_->word_count)
+			return false;
+
+		auto rank = id_to_rank_[number];
+
+		if (rank == dawg_no_rank || rank >= header_->key_count)
+			return false;
+
+		uint32_t node = 0;
+
+		while (!(is_final(nodes_[node]) && rank == 0))
+		{
+			const auto first = edges_ + nodes_[node].first_edge;
+			const auto last = first + (nodes_[node].edge_count & ~dawg_final_flag);
+
+			// The last edge that does not start past the rank leads to the word
+			const auto it = std::upper_bound(first, last, rank, [](const uint32_t r, const dawg_edge& edge)
+			{
+				return r < edge.before;
+			}) - 1;
+
+			if (it < first)
+				return false;
+
+			word.push_back(static_cast<wchar_t>(it->letter));
+			rank -= it->before;
+			node = it->target;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Collects the int codes of all dictionary variants of a word - the word itself and every word that differs
+	 * from it only by diacritics added to its letters, ordered as the variant words themselves
+	 */
+	void variants(const std::wstring_view word, std::vector<int32_t>& ids) const
+	{
+		ids.clear();
+
+		if (header_ && !word.empty())
+			walk_variants(word, 0, 0, 0, ids);
+	}
+
+	size_t size() const
+	{
+		return header_ ? header_->word_count : 0;
+	}
+
+	/**
+	 * @return Bytes taken by the automaton and the rank translation tables
+	 */
+	size_t memory_size() const
+	{
+		if (!header_)
+			return 0;
+
+		return sizeof(dawg_file_header) + header_->node_count * sizeof(dawg_node) +
+			header_->edge_count * sizeof(dawg_edge) + header_->key_count * sizeof(int32_t) +
+			(header_->word_count + 1) * sizeof(uint32_t);
+	}
+
+	bool empty() const
+	{
+		return header_ == nullptr;
+	}
+};
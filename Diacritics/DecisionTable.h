@@ -0,0 +1,164 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "MemoryMap.h"
+
+/**
+ * Header of the decision tables, the sections that follow are:\n
+ * unigram_winners - INT32[key_count], the variant with the highest unigram count of every folded form\n
+ * trigrams - trigram_decision[trigram_slots], open addressing table with linear probing\n
+ * bigrams - bigram_decision[bigram_slots], open addressing table with linear probing\n
+ * Folded forms are identified by their key numbers in the folded index (see folded_index::key_of)
+ */
+struct decision_tables_header
+{
+	char magic[8];
+	uint32_t word_count;
+	uint32_t key_count;
+	uint32_t trigram_slots;
+	uint32_t bigram_slots;
+	uint64_t model_fingerprint;
+};
+
+/**
+ * The winning middle word of a folded trigram and the lead of its count over the best triplet with another middle
+ * word, an empty slot has no winner
+ */
+struct trigram_decision
+{
+	uint32_t left;
+	uint32_t middle;
+	uint32_t right;
+	int32_t winner;
+	int32_t margin;
+};
+
+/**
+ * Back-off decisions of a folded bigram (first, second) - the winning second word when the first one precedes
+ * the word in question and the winning first word when the second one follows it, both with the highest bigram count
+ */
+struct bigram_decision
+{
+	uint32_t first;
+	uint32_t second;
+	int32_t left_winner;
+	int32_t right_winner;
+	int32_t count;
+};
+
+static const char decision_tables_magic[8] = {'D', 'I', 'A', 'C', 'D', 'E', 'C', '2'};
+
+/**
+ * @return Hash of up to three key numbers of the folded index
+ */
+inline uint64_t hash_folded_keys(const uint32_t a, const uint32_t b, const uint32_t c = 0)
+{
+	auto h = (static_cast<uint64_t>(a) << 32 | b) * 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(c) * 0xc2b2ae3d27d4eb4fULL;
+
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 29;
+
+	return h;
+}
+
+/**
+ * Precompiled answers of the model for words without diacritics - the winning middle word of every folded trigram
+ * and the back-off winners of every folded bigram and unigram, so the word in question is resolved by one or two
+ * hash probes instead of reading the trigram blocks of all its variants
+ */
+class decision_tables
+{
+	mem_map mm_;
+	const decision_tables_header* header_ = nullptr;
+	const int32_t* unigram_winners_ = nullptr;
+	const trigram_decision* trigrams_ = nullptr;
+	const bigram_decision* bigrams_ = nullptr;
+
+public:
+	decision_tables() = default;
+
+	/**
+	 * Maps the tables, the object evaluates to false if the file is missing, damaged or made for another dictionary
+	 * or model (see model_fingerprint)
+	 */
+	decision_tables(const std::string& file_name, const size_t word_count, const size_t key_count,
+	                const uint64_t fingerprint) : mm_(file_name)
+	{
+		const auto header = reinterpret_cast<const decision_tables_header*>(
+			mm_.block(0, sizeof(decision_tables_header)));
+
+		if (!header || memcmp(header->magic, decision_tables_magic, sizeof decision_tables_magic) != 0 ||
+			header->word_count != word_count || header->key_count != key_count ||
+			header->model_fingerprint != fingerprint ||
+			header->trigram_slots == 0 || (header->trigram_slots & (header->trigram_slots - 1)) != 0 ||
+			header->bigram_slots == 0 || (header->bigram_slots & (header->bigram_slots - 1)) != 0)
+			return;
+
+		auto offset = sizeof(decision_tables_header);
+
+		unigram_winners_ = reinterpret_cast<const int32_t*>(mm_.block(offset, key_count * sizeof(int32_t)));
+		offset += key_count * sizeof(int32_t);
+
+		trigrams_ = reinterpret_cast<const trigram_decision*>(
+			mm_.block(offset, header->trigram_slots * sizeof(trigram_decision)));
+		offset += header->trigram_slots * sizeof(trigram_decision);
+
+		bigrams_ = reinterpret_cast<const bigram_decision*>(
+			mm_.block(offset, header->bigram_slots * sizeof(bigram_decision)));
+
+		if ((key_count == 0 || unigram_winners_) && trigrams_ && bigrams_)
+			header_ = header;
+	}
+
+	explicit operator bool() const
+	{
+		return header_ != nullptr;
+	}
+
+	/**
+	 * @return The variant of the folded form with the highest unigram count
+	 */
+	[[nodiscard]] int32_t unigram(const uint32_t middle) const
+	{
+		return unigram_winners_[middle];
+	}
+
+	/**
+	 * @return The decision of the folded trigram, nullptr if no triplet of the model folds into it
+	 */
+	[[nodiscard]] const trigram_decision* trigram(const uint32_t left, const uint32_t middle, const uint32_t right) const
+	{
+		const auto mask = header_->trigram_slots - 1;
+
+		for (auto slot = hash_folded_keys(left, middle, right) & mask;; slot = (slot + 1) & mask)
+		{
+			const auto& decision = trigrams_[slot];
+
+			if (decision.winner == 0)
+				return nullptr;
+			if (decision.left == left && decision.middle == middle && decision.right == right)
+				return &decision;
+		}
+	}
+
+	/**
+	 * @return The decisions of the folded bigram, nullptr if no triplet of the model starts with it
+	 */
+	[[nodiscard]] const bigram_decision* bigram(const uint32_t first, const uint32_t second) const
+	{
+		const auto mask = header_->bigram_slots - 1;
+
+		for (auto slot = hash_folded_keys(first, second) & mask;; slot = (slot + 1) & mask)
+		{
+			const auto& decision = bigrams_[slot];
+
+			if (decision.left_winner == 0)
+				return nullptr;
+			if (decision.first == first && decision.second == second)
+				return &decision;
+		}
+	}
+};
@@ -1,10 +1,12 @@
 ﻿#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
 #define _CRT_SECURE_NO_WARNINGS
 #define STDIO_EXPERIMENTAL 1
+#define NOMINMAX
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <codecvt>
 #include <algorithm>
 #include <cstdint>
@@ -12,9 +14,14 @@
 #include <map>
 #include <cstdio>
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
 
 #include <unordered_map>
 #include <set>
+#include <deque>
+#include <optional>
+#include <cwctype>
 
 #include "WordStructures.h"
 #include "LookupStructures.h"
@@ -33,14 +40,33 @@
 #include "ErrorHandler.h"
 #include "BinaryReader.h"
 #include "DataPreparation.h"
+#include "TrigramModel.h"
+#include "MatchKernel.h"
+#include "Benchmark.h"
+#include "CountTables.h"
+#include "FoldedIndex.h"
+#include "DawgDictionary.h"
+#include "DecisionTable.h"
+#include "BloomFilter.h"
+#include "VariantCache.h"
+#include "ThreadPool.h"
+#include "Tokenizer.h"
+#include "BatchInput.h"
 
 #pragma execution_character_set("utf-8")
 
 using namespace std::chrono_literals;
-using word_wrapper = std::list<std::wstring*>;
 
-static std::mutex result_words_mutex,
-                  foreign_words_mutex;
+// Order numbers and formatted results of the words in question of one sentence
+using sentence_results = std::vector<std::pair<int64_t, std::wstring>>;
+
+static std::mutex foreign_words_mutex;
+
+// Variants of the words seen by any text processor of the process
+static variant_cache shared_variants;
+
+// Workers of all text processors of the process, started once the options are known
+static std::unique_ptr<work_stealing_pool> shared_workers;
 
 
 #ifdef DEBUG
@@ -100,15 +126,27 @@ class user_options
 	bool silence_ = false;
 	bool conflict_ = false;
 	bool mem_map_ = false;
+	model_format model_format_ = model_format::automatic;
+	dictionary_backend dictionary_backend_ = dictionary_backend::hashed;
+	size_t candidate_cap_ = 0;
+	bool decision_tables_ = true;
 
 	friend class text_processor;
 
 public:
 	
-	user_options(const bool silence, const bool conflict)
+	user_options(const bool silence, const bool conflict, const bool mem_map = false,
+	             const model_format format = model_format::automatic,
+	             const dictionary_backend backend = dictionary_backend::hashed, const size_t candidate_cap = 0,
+	             const bool decision_tables = true)
 	{
 		this->silence_ = silence;
 		this->conflict_ = conflict;
+		this->mem_map_ = mem_map;
+		this->model_format_ = format;
+		this->dictionary_backend_ = backend;
+		this->candidate_cap_ = candidate_cap;
+		this->decision_tables_ = decision_tables;
 	}
 };
 
@@ -117,180 +155,473 @@ class processor_state
 	std::wstring first_w_with_format_, second_w_with_format_, third_w_with_format_;
 	std::wstring carry_over_word_;
 
-	std::map<int, const std::wstring> result_words_;
-	std::map<int, const std::wstring> result_formats_;
-
 	std::set<std::wstring> potentially_foreign_words_;
-	std::vector<std::future<void>> word_futures_;
+
+	// Words of the sentence being collected and the order numbers and formats of its words in question
+	std::vector<text_word> sentence_words_;
+	std::vector<std::pair<int64_t, std::wstring>> sentence_middles_;
+
+	// Reorder buffer - sentences handed over to the workers in the order of the text, with the order number
+	// of their last word in question
+	std::deque<std::pair<int64_t, std::future<sentence_results>>> pending_sentences_;
+
+	// Results and whitespace that follows the words from 'next_output_' on, the text up to it has been written
+	std::deque<std::optional<std::wstring>> pending_words_;
+	std::deque<std::wstring> pending_formats_;
+	int64_t next_output_ = 0;
+	bool input_finished_ = false;
 
 	friend class text_processor;
 };
 
+/**
+ * Longest run of words in question decoded as one sentence lattice
+ */
+constexpr size_t lattice_sentence_limit = 64;
+
+/**
+ * Sentences per worker the reorder buffer holds before the reading waits for the oldest one
+ */
+constexpr size_t reorder_buffer_sentences = 4;
+
+/**
+ * Most distinct words missing from the dictionary recorded per document
+ */
+constexpr size_t foreign_word_limit = 1 << 16;
+
+/**
+ * One word of a sentence lattice - the word is prepared, its variants are found and the blocks of its variants
+ * are searched at most once, no matter how many triplets the word is part of
+ */
+struct lattice_token
+{
+	std::wstring raw;
+	std::wstring word;
+
+	bool mapped = false;
+	std::vector<int32_t> ids;
+
+	// Variants combined when the word is a context word and the position of every variant among them (-1 if left out)
+	std::vector<int32_t> context;
+	std::vector<int32_t> context_position;
+
+	unsigned evidence_flags = 0;
+	std::vector<block_evidence> evidence;
+};
+
+/**
+ * Word mapping, model and lookup structures, loaded once and only read afterwards, so that any number of text
+ * processors can share them\n
+ * The automaton replaces the word mapping and the folded index (and the decision tables keyed by it) when it is
+ * selected, so only one dictionary structure stays loaded
+ */
+struct language_data
+{
+	std::unique_ptr<trigram_model> model;
+	word_mapping wm;
+	uint64_t fingerprint;
+	folded_index fi;
+	dawg_dictionary dawg;
+	count_tables counts;
+	decision_tables decisions;
+	bloom_filter bloom;
+
+	language_data(const model_format format, const dictionary_backend backend) : model(load_model(format)),
+		wm(load_dictionary(binary_dictionary_name, dictionary_name)),
+		fingerprint(model_fingerprint(*model, wm.size())),
+		fi(backend == dictionary_backend::dawg ? folded_index() : load_folded_index(folded_index_name, wm)),
+		dawg(backend == dictionary_backend::dawg ? load_dawg_dictionary(dawg_dictionary_name, wm) : dawg_dictionary()),
+		counts(count_tables_name, wm.size(), fingerprint),
+		decisions(backend == dictionary_backend::dawg
+			          ? decision_tables()
+			          : decision_tables(decision_tables_name, wm.size(), fi.key_count(), fingerprint)),
+		bloom(bloom_filter_name, wm.size(), fingerprint)
+	{
+		// The word mapping was only needed to check or build the automaton
+		if (!dawg.empty())
+			wm = word_mapping();
+	}
+};
+
 /**
  * Diacritic adding text processor\n
- * The instance has its own word mapping and model
+ * The instance has its own state of the document being processed, the word mapping and model can be shared
  */
 class text_processor
 {
-	offset_table ot_;
-	word_mapping wm_;
+	std::shared_ptr<language_data> data_;
+	trigram_model& model_;
+	const word_mapping& wm_;
+	const folded_index& fi_;
+	const dawg_dictionary& dawg_;
+	const count_tables& counts_;
+	const decision_tables& decisions_;
+	const bloom_filter& bloom_;
 	processor_state s_;
 	user_options opt_ = user_options(true, false);
-	mem_map mm_ = mem_map(model_name);
 
 public:
 
-	explicit text_processor(user_options& opt) : ot_(load_compressed_model(offset_model_name)),
-	                                             wm_(load_word_mapping(dictionary_name))
+	/**
+	 * Loads the word mapping and model
+	 */
+	explicit text_processor(user_options& opt) : text_processor(
+		opt, std::make_shared<language_data>(opt.model_format_, opt.dictionary_backend_))
+	{
+		if (opt_.mem_map_)
+			model_.prefault();
+	}
+
+	/**
+	 * Shares the word mapping and model of another processor, 'opt' has to select the same model format
+	 * and dictionary
+	 */
+	text_processor(user_options& opt, std::shared_ptr<language_data> data) : data_(std::move(data)),
+		model_(*data_->model), wm_(data_->wm), fi_(data_->fi), dawg_(data_->dawg), counts_(data_->counts),
+		decisions_(data_->decisions), bloom_(data_->bloom)
 	{
 		opt_ = opt;
 	}
 
+	text_processor(const text_processor&) = delete;
+	text_processor& operator=(const text_processor&) = delete;
+
+	const std::shared_ptr<language_data>& data() const
+	{
+		return data_;
+	}
+
+	/**
+	 * @return The word with the int code, spelled by the automaton when it replaces the word mapping
+	 */
+	std::wstring int_to_word(const int number) const
+	{
+		if (!dawg_.empty())
+		{
+			std::wstring word;
+			dawg_.int_to_word(number, word);
+
+			return word;
+		}
+
+		return std::wstring(wm_.int_to_word(number));
+	}
+
+	/**
+	 * Looks up the int codes of all variants of the word in the selected dictionary structure
+	 */
+	void expand_variants(std::wstring& w, std::vector<int32_t>& ids) const
+	{
+		if (!dawg_.empty())
+		{
+			dawg_.variants(w, ids);
+			return;
+		}
+
+		if (!fi_.empty())
+		{
+			fi_.variants(wm_, w, ids);
+			return;
+		}
+
+		ids.clear();
+
+		for (const auto& variant : get_variants(wm_, w))
+		{
+			const auto mapped = wm_.word_to_int(variant);
+
+			if (mapped != 0)
+				ids.push_back(mapped);
+		}
+	}
+
 	/**
-	 * Reads the model file and searches for a variant of words passed via arguments
+	 * @return Int codes of all variants of the word that are present in the dictionary
+	 */
+	std::vector<int32_t> mapped_variants(std::wstring& w) const
+	{
+		std::vector<int32_t> ids;
+
+		if (shared_variants.find(w, ids))
+			return ids;
+
+		expand_variants(w, ids);
+		shared_variants.insert(w, ids);
+
+		return ids;
+	}
+
+	/**
+	 * Classifies the word by the number of its variants in the dictionary
 	 *
-	 * @param second_w_mapped The word in question - to have diacritics added to it
-	 * @param first_w_mapped The word directly preceding the word in question in text (optional)
-	 * @param third_w_mapped The word directly following the word in question in text (optional)
-	 * @param variant_map word, tuple or triplet map to which every satisfactory combination will be added
+	 * @param id Set to the int code of the variant for the single variant words
 	 */
-	template <typename T>
-	void search_model_for(std::map<int, std::vector<T>>& variant_map, const int second_w_mapped, int first_w_mapped = 0,
-	                      int third_w_mapped = 0)
+	ambiguity_class classify(std::wstring& w, int32_t& id) const
 	{
-		PROFILE_FUNCTION();
+		// A single probe of the folded index costs less than a lookup in the variant cache
+		if (dawg_.empty() && !fi_.empty())
+			return fi_.ambiguity(wm_, w, id);
 
-		std::unique_ptr<binary_reader> mif;
+		const auto ids = mapped_variants(w);
 
-		if (opt_.mem_map_)
+		if (ids.size() == 1)
+			id = ids.front();
+
+		return ids.empty() ? ambiguity_class::none : ids.size() == 1 ? ambiguity_class::single : ambiguity_class::ambiguous;
+	}
+
+	/**
+	 * Looks the word in question up in the decision tables, the triplet decides if the model has it, otherwise
+	 * the bigram decisions of both neighbours are compared as in most_common_triplet\n
+	 * The tables cover the full variant sets only, so words that already have diacritics are left to the model
+	 *
+	 * @param id Set to the int code of the winning variant
+	 * @return False if the tables are not installed, not used or cannot decide
+	 */
+	bool decide(const std::wstring& first_w, const std::wstring& second_w, const std::wstring& third_w,
+	            int32_t& id) const
+	{
+		const auto folded = [](const std::wstring& w)
 		{
-			mif = std::unique_ptr<binary_reader>(std::make_unique<mmap_binary_reader>(mm_));
+			return std::all_of(w.begin(), w.end(), [](const wchar_t c) { return fold_letter(c) == c; });
+		};
+
+		if (!decisions_ || !opt_.decision_tables_ || !folded(first_w) || !folded(second_w) || !folded(third_w))
+			return false;
+
+		uint32_t left = 0, middle = 0, right = 0;
+
+		if (!fi_.key_of(wm_, second_w, middle))
+			return false;
+
+		const auto has_left = fi_.key_of(wm_, first_w, left);
+		const auto has_right = fi_.key_of(wm_, third_w, right);
+
+		if (has_left && has_right)
+		{
+			if (const auto decision = decisions_.trigram(left, middle, right))
+			{
+				id = decision->winner;
+				return true;
+			}
 		}
+
+		const auto first_two = has_left ? decisions_.bigram(left, middle) : nullptr;
+		const auto second_two = has_right ? decisions_.bigram(middle, right) : nullptr;
+
+		const auto first_two_count = first_two ? first_two->count : 0;
+		const auto second_two_count = second_two ? second_two->count : 0;
+
+		// Same choice as in most_common_triplet, a missing bigram falls back to the unigram winner
+		if (first_two_count < second_two_count)
+			id = first_two ? first_two->left_winner : decisions_.unigram(middle);
 		else
+			id = second_two ? second_two->right_winner : decisions_.unigram(middle);
+
+		return true;
+	}
+
+	/**
+	 * Reads the block of the middle word once and collects all requested evidence from it\n
+	 * Unigrams and bigrams are single lookups in the precomputed tables when they are installed, the conflict mode
+	 * keeps scanning for bigrams as it offers every matching record to the user
+	 *
+	 * @param second_w_mapped The word in question - to have diacritics added to it
+	 * @param left Variants of the word directly preceding the word in question
+	 * @param right Variants of the word directly following the word in question
+	 * @param flags Combination of evidence_total, evidence_left and evidence_pairs
+	 * @param evidence Storage for the collected evidence
+	 */
+	void gather_evidence(const int32_t second_w_mapped, const std::vector<int32_t>& left,
+	                     const std::vector<int32_t>& right, unsigned flags, block_evidence& evidence)
+	{
+		PROFILE_FUNCTION();
+
+		evidence.clear();
+
+		if (counts_ && flags & evidence_total)
 		{
-			mif = std::unique_ptr<binary_reader>(std::make_unique<ifstream_binary_reader>(model_name));
+			evidence.total = counts_.unigram(second_w_mapped);
+			flags &= ~evidence_total;
 		}
-		
-		auto arg_count = 3;
 
-		if (first_w_mapped == 0)
-			arg_count = 1;
-		else if (third_w_mapped == 0)
-			arg_count = 2;
-
-		const size_t offset = ot_.get_value(second_w_mapped);
-		
-		mif->seek(offset * 4 * 4, std::ios::beg);
+		if (counts_ && flags & evidence_left && !opt_.conflict_)
+		{
+			int32_t count;
 
-		auto individual_count = 0;
+			for (uint32_t i = 0; i < left.size(); i++)
+				if (counts_.bigram(second_w_mapped, left[i], count))
+					evidence.left_hits.emplace_back(i, count);
 
-		auto second_w_read = mif->read_4_bytes();
+			flags &= ~evidence_left;
+		}
 
-		while (second_w_read == second_w_mapped)
+		// Contexts the filter rejects have no records in the block, if it rejects all of them the block is not read
+		if (bloom_ && flags & (evidence_left | evidence_pairs))
 		{
-			const auto first_w_read = mif->read_4_bytes();
-			const auto third_w_read = mif->read_4_bytes();
-			auto count_read = mif->read_4_bytes();
+			auto any_pair = false, any_triplet = false;
 
-			switch (arg_count)
+			for (const auto first_w_mapped : left)
 			{
-			case 1:
-				individual_count += count_read;
-				break;
-			case 2:
-				if (first_w_mapped == first_w_read)
-					variant_map[count_read].emplace_back(T(first_w_mapped, second_w_read, 0));
-				break;
-			case 3:
-				if (first_w_mapped == first_w_read && third_w_mapped == third_w_read)
-					variant_map[count_read].emplace_back(T(first_w_mapped, second_w_read, third_w_mapped));
-				break;
-			default:
-				throw;
+				if (!bloom_.may_contain(first_w_mapped, second_w_mapped))
+					continue;
+
+				any_pair = true;
+
+				if (!(flags & evidence_pairs))
+					break;
+
+				for (const auto third_w_mapped : right)
+				{
+					if (bloom_.may_contain(first_w_mapped, second_w_mapped, third_w_mapped))
+					{
+						any_triplet = true;
+						break;
+					}
+				}
+
+				if (any_triplet)
+					break;
 			}
 
-			second_w_read = mif->read_4_bytes();
+			if (!any_pair)
+				flags &= ~evidence_left;
+			if (!any_triplet)
+				flags &= ~evidence_pairs;
 		}
 
-		if (arg_count == 1)
-			variant_map[individual_count].emplace_back(T(second_w_mapped, 0, 0));
+		if (flags == 0)
+			return;
+
+		// The whole block of the middle word is fetched at once, formats that copy or decode reuse the per-thread buffer
+		thread_local std::vector<model_record> block_buffer;
+
+		collect_evidence(active_kernels(), model_.read_block(second_w_mapped, block_buffer), left, right, flags,
+		                 evidence);
 	}
 
 	/**
-	 * Searches for the most common individual word variant
+	 * Bounds the candidate product of the triplet and tuple searches - only the variants of a context word with
+	 * the highest unigram counts are combined with the variants of the word in question\n
+	 * The kept variants stay in their original order, so ties are broken as in the exact search (the cap of 0)
 	 *
-	 * @param first_w The word in question - to have diacritics added to it
-	 * @return The most probable variant of the word in question
+	 * @param ids Variants of a context word
+	 * @return At most 'candidate_cap_' of the variants
 	 */
-	const std::wstring& most_common(std::wstring& first_w)
+	std::vector<int32_t> capped_context(std::vector<int32_t> ids)
 	{
-		PROFILE_FUNCTION();
+		if (opt_.candidate_cap_ == 0 || ids.size() <= opt_.candidate_cap_)
+			return ids;
 
-		auto first_w_variants = get_variants(wm_, first_w);
+		std::vector<std::pair<int32_t, size_t>> ranked;
+		block_evidence evidence;
 
-		std::map<int, std::vector<word>> variant_map;
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			gather_evidence(ids[i], {}, {}, evidence_total, evidence);
+			ranked.emplace_back(evidence.total, i);
+		}
 
-		for (auto first_w_variant : first_w_variants)
+		// The most frequent variants first, the earlier of equally frequent ones first
+		std::partial_sort(ranked.begin(), ranked.begin() + opt_.candidate_cap_, ranked.end(),
+		                  [](const std::pair<int32_t, size_t>& a, const std::pair<int32_t, size_t>& b)
+		                  {
+			                  return a.first > b.first || (a.first == b.first && a.second < b.second);
+		                  });
+
+		ranked.resize(opt_.candidate_cap_);
+
+		std::sort(ranked.begin(), ranked.end(), [](const std::pair<int32_t, size_t>& a, const std::pair<int32_t, size_t>& b)
 		{
-			const auto first_w_mapped = wm_.word_to_int(first_w_variant);
+			return a.second < b.second;
+		});
 
-			if (first_w_mapped == 0)
-				continue;
+		std::vector<int32_t> kept;
+
+		for (const auto& candidate : ranked)
+			kept.push_back(ids[candidate.second]);
+
+		return kept;
+	}
 
-			variant_map[0].emplace_back(first_w_mapped);
+	/**
+	 * Records a word that is not in the dictionary, the words are only counted to tell texts in another language,
+	 * so a document keeps at most 'foreign_word_limit' of them
+	 */
+	void add_foreign_word(const std::wstring& w)
+	{
+		std::lock_guard<std::mutex> lock(foreign_words_mutex);
 
-			search_model_for(variant_map, first_w_mapped);
+		if (s_.potentially_foreign_words_.size() < foreign_word_limit)
+			s_.potentially_foreign_words_.emplace(w);
+	}
+
+	/**
+	 * Picks the most common individual word variant
+	 *
+	 * @param first_w The word in question, it is returned as it is if it has no variant in the dictionary
+	 * @param ids Variants of the word in question
+	 * @param totals Unigram counts of the variants
+	 * @return The most probable variant of the word in question
+	 */
+	std::wstring resolve_word(std::wstring& first_w, const std::vector<int32_t>& ids,
+	                          const std::vector<int32_t>& totals)
+	{
+		std::map<int, std::vector<word>> variant_map;
+
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			variant_map[0].emplace_back(ids[i]);
+			variant_map[totals[i]].emplace_back(ids[i]);
 		}
 
 		if (variant_map.empty())
 		{
-			std::lock_guard<std::mutex> lock(foreign_words_mutex);
-			s_.potentially_foreign_words_.emplace(first_w);
+			add_foreign_word(first_w);
 			return first_w;
 		}
 		
 		if (opt_.conflict_)
-			return *wm_.int_to_word(handle_conflict(variant_map, std::vector<std::wstring> {s_.first_w_with_format_, s_.second_w_with_format_, s_.third_w_with_format_}).second.first_w);
-		return *wm_.int_to_word(variant_map.crbegin()->second.begin()->first_w);
+			return int_to_word(handle_conflict(variant_map, std::vector<std::wstring> {s_.first_w_with_format_, s_.second_w_with_format_, s_.third_w_with_format_}).second.first_w);
+		return int_to_word(variant_map.crbegin()->second.begin()->first_w);
 	}
 
 	/**
-	 * Searches for the most common two word variant
+	 * Searches for the most common individual word variant
 	 *
-	 *@param first_w The word directly preceding the word in question
-	 * @param second_w The word in question - to have diacritics added to it
-	 * @return The most probable variant of both words and their count in the model
+	 * @param first_w The word in question - to have diacritics added to it
+	 * @return The most probable variant of the word in question
 	 */
-	word_tuple_count_pair most_common_tuple(std::wstring& first_w, std::wstring& second_w)
+	std::wstring most_common(std::wstring& first_w)
 	{
 		PROFILE_FUNCTION();
 
-		auto first_w_variants = get_variants(wm_, first_w);
-		auto second_w_variants = get_variants(wm_, second_w);
+		const auto ids = mapped_variants(first_w);
 
-		std::map<int, std::vector<word_tuple>> variant_map;
+		std::vector<int32_t> totals;
+		block_evidence evidence;
 
-		for (auto second_w_variant : second_w_variants)
+		for (const auto first_w_mapped : ids)
 		{
-			const auto second_w_mapped = wm_.word_to_int(second_w_variant);
-
-			if (second_w_mapped == 0)
-				continue;
-
-			for (auto first_w_variant : first_w_variants)
-			{
-				const auto first_w_mapped = wm_.word_to_int(first_w_variant);
-
-				if (first_w_mapped == 0)
-					continue;
-
-				search_model_for(variant_map, second_w_mapped, first_w_mapped);
-			}
+			gather_evidence(first_w_mapped, {}, {}, evidence_total, evidence);
+			totals.push_back(evidence.total);
 		}
 
+		return resolve_word(first_w, ids, totals);
+	}
+
+	/**
+	 * Picks the most common two word variant
+	 *
+	 * @param fallback Provides the result if the variant map is empty
+	 * @return The most probable variant of both words and their count in the model
+	 */
+	template <typename Fallback>
+	word_tuple_count_pair resolve_tuple(std::map<int, std::vector<word_tuple>>& variant_map, Fallback&& fallback)
+	{
 		if (variant_map.empty())
 		{
-			return {&most_common(first_w), &most_common(second_w), 0};
+			return fallback();
 		}
 
 		if (opt_.conflict_)
@@ -298,20 +629,70 @@ public:
 			const auto best_match = handle_conflict(variant_map, std::vector<std::wstring> {s_.first_w_with_format_, s_.second_w_with_format_, s_.third_w_with_format_});
 
 			return {
-				wm_.int_to_word(best_match.second.first_w),
-				wm_.int_to_word(best_match.second.second_w),
+				int_to_word(best_match.second.first_w),
+				int_to_word(best_match.second.second_w),
 				best_match.first
 			};
 		}
 		return {
-			wm_.int_to_word(variant_map.crbegin()->second.begin()->first_w),
-			wm_.int_to_word(variant_map.crbegin()->second.begin()->second_w),
+			int_to_word(variant_map.crbegin()->second.begin()->first_w),
+			int_to_word(variant_map.crbegin()->second.begin()->second_w),
 			variant_map.crbegin()->first
 		};
 	}
 
 	/**
-	 * Searches for the most common three word variant
+	 * Searches for the most common two word variant, the bigrams and the unigrams of the second word
+	 * are collected from the same read of its blocks
+	 *
+	 * @param second_ids Variants of the second word
+	 * @param first_ids Variants of the first word
+	 * @param first_fallback Provides the most common variant of the first word if no bigram is found
+	 */
+	template <typename FirstFallback>
+	word_tuple_count_pair tuple_from_blocks(std::wstring& second_w, const std::vector<int32_t>& second_ids,
+	                                        const std::vector<int32_t>& first_ids, FirstFallback&& first_fallback)
+	{
+		std::map<int, std::vector<word_tuple>> variant_map;
+		std::vector<int32_t> second_totals;
+		block_evidence evidence;
+
+		for (const auto second_w_mapped : second_ids)
+		{
+			gather_evidence(second_w_mapped, first_ids, {}, evidence_total | evidence_left, evidence);
+
+			for (const auto& [i, count] : evidence.left_hits)
+				variant_map[count].emplace_back(first_ids[i], second_w_mapped);
+
+			second_totals.push_back(evidence.total);
+		}
+
+		return resolve_tuple(variant_map, [&]
+		{
+			return word_tuple_count_pair{first_fallback(), resolve_word(second_w, second_ids, second_totals), 0};
+		});
+	}
+
+	/**
+	 * Searches for the most common two word variant
+	 *
+	 *@param first_w The word directly preceding the word in question
+	 * @param second_w The word in question - to have diacritics added to it
+	 * @return The most probable variant of both words and their count in the model
+	 */
+	word_tuple_count_pair most_common_tuple(std::wstring& first_w, std::wstring& second_w)
+	{
+		PROFILE_FUNCTION();
+
+		const auto first_ids = capped_context(mapped_variants(first_w));
+		const auto second_ids = mapped_variants(second_w);
+
+		return tuple_from_blocks(second_w, second_ids, first_ids, [&] { return most_common(first_w); });
+	}
+
+	/**
+	 * Searches for the most common three word variant\n
+	 * A single read of every block of the word in question yields the triplets together with the evidence for the back-off
 	 *
 	 * @param first_w The word directly preceding the word in question
 	 * @param second_w The word in question - to have diacritics added to it
@@ -319,7 +700,7 @@ public:
 
 	 * @return The most probable variant of the word in question
 	 */
-	const std::wstring* most_common_triplet(std::wstring& first_w, std::wstring& second_w, std::wstring& third_w)
+	std::wstring most_common_triplet(std::wstring& first_w, std::wstring& second_w, std::wstring& third_w)
 	{
 		PROFILE_FUNCTION();
 
@@ -327,137 +708,439 @@ public:
 
 		if (can_have_diacritic)
 		{
-			auto first_w_variants = get_variants(wm_, first_w);
-			auto second_w_variants = get_variants(wm_, second_w);
-			auto third_w_variants = get_variants(wm_, third_w);
+			const auto first_ids = capped_context(mapped_variants(first_w));
+			const auto second_ids = mapped_variants(second_w);
+			const auto third_ids = capped_context(mapped_variants(third_w));
 
 			std::map<int, std::vector<word_triplet>> variant_map;
+			std::map<int, std::vector<word_tuple>> first_two_map;
+			std::vector<int32_t> second_totals;
+			block_evidence evidence;
 
-			for (auto second_w_variant : second_w_variants)
+			for (const auto second_w_mapped : second_ids)
 			{
-				const auto second_w_mapped = wm_.word_to_int(second_w_variant);
+				gather_evidence(second_w_mapped, first_ids, third_ids, evidence_total | evidence_left | evidence_pairs,
+				                evidence);
 
-				if (second_w_mapped == 0)
-					continue;
+				for (const auto& [i, j, count] : evidence.pair_hits)
+					variant_map[count].emplace_back(first_ids[i], second_w_mapped, third_ids[j]);
 
-				for (auto first_w_variant : first_w_variants)
-				{
-					const auto first_w_mapped = wm_.word_to_int(first_w_variant);
-
-					if (first_w_mapped == 0)
-						continue;
-
-					for (auto third_w_variant : third_w_variants)
-					{
-						const auto third_w_mapped = wm_.word_to_int(third_w_variant);
-
-						if (third_w_mapped == 0)
-							continue;
+				for (const auto& [i, count] : evidence.left_hits)
+					first_two_map[count].emplace_back(first_ids[i], second_w_mapped);
 
-						search_model_for(variant_map, second_w_mapped, first_w_mapped, third_w_mapped);
-					}
-				}
+				second_totals.push_back(evidence.total);
 			}
 
 			if (variant_map.empty())
 			{
 				// RETURN VALUE -->	| FIRST_WORD | SECOND_WORD | COUNT |
-				const auto first_two_words = most_common_tuple(first_w, second_w);
+				const auto first_two_words = resolve_tuple(first_two_map, [&]
+				{
+					return word_tuple_count_pair{most_common(first_w), resolve_word(second_w, second_ids, second_totals), 0};
+				});
 
 				// RETURN VALUE --> | SECOND_WORD | THIRD_WORD | COUNT |
-				const auto second_two_words = most_common_tuple(second_w, third_w);
+				const auto second_two_words = tuple_from_blocks(third_w, third_ids, second_ids, [&]
+				{
+					return resolve_word(second_w, second_ids, second_totals);
+				});
+
+				if (first_two_words.count < second_two_words.count)
+				{
+					return first_two_words.second_w;
+				}
+				return second_two_words.first_w;
+			}
+
+			if (opt_.conflict_)
+				return int_to_word(handle_conflict(variant_map, std::vector<std::wstring> {s_.first_w_with_format_, s_.second_w_with_format_, s_.third_w_with_format_}).second.second_w);
+			return int_to_word(variant_map.crbegin()->second.begin()->second_w);
+		}
+
+		return second_w;
+	}
+
+	/**
+	 * Procedure for one triplet iteration\n
+	 * Gets the most common variant of second_w, applies previous formatting to it and adds it to the results
+	 */
+	void fill_result_word(const text_word& first, const text_word& second, const text_word& third,
+	                      int64_t triplet_order_number, const std::wstring& second_w_with_format,
+	                      sentence_results& results)
+	{
+		PROFILE_FUNCTION();
+
+		if (is_formatting_string(second.raw))
+			return;
+
+		auto first_w = first.word, second_w = second.word, third_w = third.word;
+
+		const auto result_word = most_common_triplet(first_w, second_w, third_w);
+
+		results.emplace_back(triplet_order_number, apply_previous_formatting(second_w_with_format, result_word));
+	}
+
+	/**
+	 * Resolves the prepared word in question without the trigram blocks - words that cannot have diacritics,
+	 * words with a single variant or none and words whose triplet the decision tables cover
+	 *
+	 * @return False if the blocks are needed
+	 */
+	bool resolve_without_blocks(std::wstring& first_w, std::wstring& second_w, std::wstring& third_w,
+	                            std::wstring& result_word)
+	{
+		if (!check_diacritic(second_w))
+		{
+			result_word = second_w;
+			return true;
+		}
+
+		int32_t id = 0;
+
+		switch (classify(second_w, id))
+		{
+		case ambiguity_class::ambiguous:
+			if (!decide(first_w, second_w, third_w, id))
+				return false;
+
+			result_word = int_to_word(id);
+			break;
+		case ambiguity_class::single:
+			result_word = int_to_word(id);
+			break;
+		case ambiguity_class::none:
+			add_foreign_word(second_w);
+			result_word = second_w;
+			break;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Finds the variants of a lattice word once, the context variants are capped as in most_common_triplet
+	 */
+	void map_token(lattice_token& token)
+	{
+		if (token.mapped)
+			return;
+
+		token.ids = mapped_variants(token.word);
+		token.context = capped_context(token.ids);
+		token.context_position.assign(token.ids.size(), -1);
+
+		for (size_t i = 0, j = 0; i < token.ids.size() && j < token.context.size(); i++)
+			if (token.ids[i] == token.context[j])
+				token.context_position[i] = static_cast<int32_t>(j++);
+
+		token.mapped = true;
+	}
+
+	/**
+	 * Searches the blocks of the variants of a lattice word once for everything the decoder needs from them -
+	 * the preceding word is always matched with all its variants, the following one with its context variants
+	 */
+	void search_token(std::vector<lattice_token>& tokens, const size_t i, const unsigned flags)
+	{
+		auto& token = tokens[i];
+
+		if ((token.evidence_flags & flags) == flags)
+			return;
+
+		map_token(token);
+		map_token(tokens[i - 1]);
+
+		if (flags & evidence_pairs)
+			map_token(tokens[i + 1]);
+
+		static const std::vector<int32_t> no_words;
+
+		const auto& left = tokens[i - 1].ids;
+		const auto& right = flags & evidence_pairs ? tokens[i + 1].context : no_words;
+
+		token.evidence.resize(token.ids.size());
+
+		for (size_t k = 0; k < token.ids.size(); k++)
+			gather_evidence(token.ids[k], left, right, flags, token.evidence[k]);
+
+		token.evidence_flags = flags;
+	}
+
+	/**
+	 * The decision of most_common_triplet for the ambiguous word tokens[i], taken from the evidence of the lattice
+	 *
+	 * @param needs_blocks Words in question of the sentence that are resolved from the blocks
+	 * @return The most probable variant of the word in question
+	 */
+	std::wstring decode_token(std::vector<lattice_token>& tokens, const size_t i,
+	                          const std::vector<bool>& needs_blocks)
+	{
+		PROFILE_FUNCTION();
+
+		auto& first = tokens[i - 1];
+		auto& second = tokens[i];
+		auto& third = tokens[i + 1];
+
+		map_token(first);
+		map_token(second);
+		map_token(third);
+
+		search_token(tokens, i, evidence_total | evidence_left | evidence_pairs);
+
+		std::map<int, std::vector<word_triplet>> variant_map;
+		std::map<int, std::vector<word_tuple>> first_two_map;
+		std::vector<int32_t> second_totals;
+
+		for (size_t k = 0; k < second.ids.size(); k++)
+		{
+			const auto& evidence = second.evidence[k];
+
+			for (const auto& [l, r, count] : evidence.pair_hits)
+				if (first.context_position[l] >= 0)
+					variant_map[count].emplace_back(first.ids[l], second.ids[k], third.context[r]);
+
+			for (const auto& [l, count] : evidence.left_hits)
+				if (first.context_position[l] >= 0)
+					first_two_map[count].emplace_back(first.ids[l], second.ids[k]);
+
+			second_totals.push_back(evidence.total);
+		}
+
+		if (!variant_map.empty())
+			return int_to_word(variant_map.crbegin()->second.begin()->second_w);
+
+		// RETURN VALUE -->	| FIRST_WORD | SECOND_WORD | COUNT |
+		const auto first_two_words = resolve_tuple(first_two_map, [&]
+		{
+			// The most common variant of the first word is not used, only a missing one is recorded
+			if (first.ids.empty())
+				add_foreign_word(first.word);
+
+			return word_tuple_count_pair{first.word, resolve_word(second.word, second.ids, second_totals), 0};
+		});
+
+		// The following word is searched once for this triplet and for its own, if it is resolved from the blocks too
+		search_token(tokens, i + 1, i + 2 < tokens.size() && needs_blocks[i + 1]
+			                            ? evidence_total | evidence_left | evidence_pairs
+			                            : evidence_total | evidence_left);
+
+		std::map<int, std::vector<word_tuple>> second_two_map;
+		std::vector<int32_t> third_totals;
+
+		for (size_t k = 0; k < third.ids.size(); k++)
+		{
+			if (third.context_position[k] < 0)
+				continue;
+
+			for (const auto& [l, count] : third.evidence[k].left_hits)
+				second_two_map[count].emplace_back(second.ids[l], third.ids[k]);
+
+			third_totals.push_back(third.evidence[k].total);
+		}
+
+		// RETURN VALUE --> | SECOND_WORD | THIRD_WORD | COUNT |
+		const auto second_two_words = resolve_tuple(second_two_map, [&]
+		{
+			return word_tuple_count_pair{
+				resolve_word(second.word, second.ids, second_totals), resolve_word(third.word, third.context, third_totals), 0
+			};
+		});
+
+		if (first_two_words.count < second_two_words.count)
+			return first_two_words.second_w;
+
+		return second_two_words.first_w;
+	}
+
+	/**
+	 * Asynchronous procedure for one sentence\n
+	 * Every word has its variants found once, the words the blocks are not needed for are resolved
+	 * first, the rest are decoded from a single search of the blocks of every word variant
+	 *
+	 * @param words All words of the sentence, the words in question are surrounded by one context word on each side
+	 * @param middles Order numbers and formats of the words in question
+	 */
+	sentence_results decode_sentence(std::vector<text_word> words, std::vector<std::pair<int64_t, std::wstring>> middles)
+	{
+		PROFILE_FUNCTION();
+
+		std::vector<lattice_token> tokens(words.size());
+
+		for (size_t i = 0; i < words.size(); i++)
+		{
+			tokens[i].raw = std::move(words[i].raw);
+			tokens[i].word = std::move(words[i].word);
+		}
+
+		std::vector<bool> needs_blocks(tokens.size(), false);
+		sentence_results results;
+
+		for (size_t k = 0; k < middles.size(); k++)
+		{
+			const auto i = k + 1;
+
+			if (is_formatting_string(tokens[i].raw))
+				continue;
+
+			std::wstring result_word;
+
+			if (resolve_without_blocks(tokens[i - 1].word, tokens[i].word, tokens[i + 1].word, result_word))
+				results.emplace_back(middles[k].first, apply_previous_formatting(middles[k].second, result_word));
+			else
+				needs_blocks[i] = true;
+		}
+
+		for (size_t k = 0; k < middles.size(); k++)
+		{
+			if (!needs_blocks[k + 1])
+				continue;
 
-				if (first_two_words.count < second_two_words.count)
-				{
-					return first_two_words.second_w;
-				}
-				return second_two_words.first_w;
-			}
+			const auto result_word = decode_token(tokens, k + 1, needs_blocks);
 
-			if (opt_.conflict_)
-				return wm_.int_to_word(handle_conflict(variant_map, std::vector<std::wstring> {s_.first_w_with_format_, s_.second_w_with_format_, s_.third_w_with_format_}).second.second_w);
-			return wm_.int_to_word(variant_map.crbegin()->second.begin()->second_w);
+			results.emplace_back(middles[k].first, apply_previous_formatting(middles[k].second, result_word));
 		}
 
-		return &second_w;
+		return results;
 	}
 
 	/**
-	 * Asynchronous procedure for one triplet iteration\n
-	 * Gets the most common variant of second_w, applies previous formatting to it and inserts it into a shared container of output words
+	 * Asynchronous procedure for one sentence in the conflict mode\n
+	 * The words in question are resolved one by one, so that every triplet is offered to the user
 	 */
-	void fill_result_word(std::wstring first_w, std::wstring second_w,
-	                      std::wstring third_w, int triplet_order_number, const std::wstring& second_w_with_format)
+	sentence_results fill_sentence_words(const std::vector<text_word>& words,
+	                                     const std::vector<std::pair<int64_t, std::wstring>>& middles)
 	{
-		PROFILE_FUNCTION();
+		sentence_results results;
 
-		if (is_formatting_string(second_w))
-			return;
+		for (size_t k = 0; k < middles.size(); k++)
+			fill_result_word(words[k], words[k + 1], words[k + 2], middles[k].first, middles[k].second, results);
 
-		prepare_words(word_wrapper{&first_w, &second_w, &third_w});
+		return results;
+	}
 
-		const auto result_word = most_common_triplet(first_w, second_w, third_w);
+	/**
+	 * Hands the collected sentence over to the workers as one task and writes out the sentences finished so far\n
+	 * Once the reorder buffer is full, the reading waits for the oldest sentence
+	 */
+	void flush_sentence(std::wostream& wof)
+	{
+		if (s_.sentence_middles_.empty())
+			return;
 
-		auto result_word_with_format = apply_previous_formatting(second_w_with_format, result_word);
+		const auto last_order_number = s_.sentence_middles_.back().first;
 
-		const auto return_val = std::pair<int, std::wstring>(triplet_order_number, result_word_with_format);
+		s_.pending_sentences_.emplace_back(last_order_number, shared_workers->submit(
+			[this, words = std::move(s_.sentence_words_), middles = std::move(s_.sentence_middles_)]() mutable
+			{
+				if (opt_.conflict_)
+					return fill_sentence_words(words, middles);
+
+				return decode_sentence(std::move(words), std::move(middles));
+			}));
 
-		std::lock_guard<std::mutex> lock(result_words_mutex);
+		s_.sentence_words_.clear();
+		s_.sentence_middles_.clear();
 
-		s_.result_words_.insert(return_val);
+		release_sentences(wof, false);
 	}
 
 	/**
-	 * Reads the stream and collects all sequences of whitespace characters into a container
+	 * Adds the result of a word, a word keeps the result it got first
 	 */
-	void get_file_formatting(std::wistream& wif)
+	void add_result(const int64_t order_number, std::wstring&& result)
 	{
-		PROFILE_FUNCTION();
+		if (order_number < s_.next_output_)
+			return;
+
+		const auto index = static_cast<size_t>(order_number - s_.next_output_);
+
+		if (index >= s_.pending_words_.size())
+			s_.pending_words_.resize(index + 1);
+
+		if (!s_.pending_words_[index])
+			s_.pending_words_[index] = std::move(result);
+	}
 
-		wchar_t c;
-		auto i = 0;
-		std::wstring format;
-		while (wif.get(c))
+	/**
+	 * Writes the words before 'end' in the order of the text, each followed by its whitespace - the writing stops
+	 * at the first word whose whitespace has not been read yet, a word without any result is written empty
+	 */
+	void write_words(std::wostream& wof, const int64_t end)
+	{
+		while (s_.next_output_ < end && (!s_.pending_formats_.empty() || s_.input_finished_))
 		{
-			if (isspace(c))
-				format.push_back(c);
-			else if (!format.empty())
+			if (!s_.pending_words_.empty())
+			{
+				if (s_.pending_words_.front())
+					wof << *s_.pending_words_.front();
+
+				s_.pending_words_.pop_front();
+			}
+
+			if (!s_.pending_formats_.empty())
 			{
-				s_.result_formats_.insert(std::pair<int, const std::wstring>(i, format));
-				format.clear();
-				i++;
+				wof << s_.pending_formats_.front();
+				s_.pending_formats_.pop_front();
 			}
+
+			s_.next_output_++;
 		}
 	}
 
 	/**
-	 * Dumps the contains of result_words_ and result_formats_ into the stream
+	 * Takes the finished sentences from the front of the reorder buffer and writes out their words\n
+	 * The last word in question of a sentence is held back, as it may be the first word in question of the next one
+	 *
+	 * @param wait_for_all Waits for all sentences, otherwise only for the oldest one while the buffer is full
 	 */
-	void print_result(std::wofstream& wof)
+	void release_sentences(std::wostream& wof, const bool wait_for_all)
 	{
-		PROFILE_FUNCTION();
+		const auto capacity = reorder_buffer_sentences * shared_workers->size();
 
-		for (auto i = 0; i < s_.result_words_.size(); i++)
+		while (!s_.pending_sentences_.empty())
 		{
-			wof << s_.result_words_[i] << s_.result_formats_[i];
+			auto& [last_order_number, future] = s_.pending_sentences_.front();
+
+			if (!wait_for_all && s_.pending_sentences_.size() <= capacity &&
+				future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				break;
+
+			for (auto& [order_number, result] : future.get())
+				add_result(order_number, std::move(result));
+
+			write_words(wof, last_order_number);
+
+			s_.pending_sentences_.pop_front();
 		}
 	}
 
 	/**
 	 * Processes current triplet\n
-	 * Calls asynchronous diacritic adding procedure for second_w and shifts the last two words of the triplet forward
+	 * Adds the triplet to the sentence, which is handed over to the workers once complete, and shifts the last two
+	 * words of the triplet forward
 	 */
-	void do_triplet_iteration(std::wstring& first_w, std::wstring& second_w, std::wstring& third_w,
-	                          int triplet_order_number)
+	void do_triplet_iteration(text_word& first, text_word& second, const text_word& third,
+	                          int64_t triplet_order_number, std::wostream& wof)
 	{
 		PROFILE_FUNCTION();
 
-		s_.word_futures_.emplace_back(std::async(std::launch::async,
-		                                      &text_processor::fill_result_word, this, first_w, second_w, third_w,
-		                                      triplet_order_number, s_.second_w_with_format_));
+		// Consecutive triplets share two words, the sentence keeps every word once
+		if (s_.sentence_words_.empty())
+		{
+			s_.sentence_words_.push_back(first);
+			s_.sentence_words_.push_back(second);
+		}
+
+		s_.sentence_words_.push_back(third);
+		s_.sentence_middles_.emplace_back(triplet_order_number, s_.second_w_with_format_);
+
+		const auto last = second.raw.empty() ? L'\0' : second.raw.back();
+
+		if (last == L'.' || last == L'?' || last == L'!' || s_.sentence_middles_.size() >= lattice_sentence_limit)
+			flush_sentence(wof);
 
-		first_w = second_w;
-		second_w = third_w;
+		first = std::move(second);
+		second = third;
 
 		s_.first_w_with_format_ = s_.second_w_with_format_;
 		s_.second_w_with_format_ = s_.third_w_with_format_;
@@ -465,109 +1148,136 @@ public:
 
 	/**
 	 * Reads the stream and processes every word triplet it encounters\n
-	 * Dumps the result into an output file based on the input stream file name
+	 * Writes the result into an output file based on the input stream file name (the standard output for other
+	 * streams) as soon as the sentences are finished
 	 */
 	void process_text(std::wistream& wif)
 	{
-		PROFILE_FUNCTION();
-
-		std::wofstream wof;
+		const auto file = dynamic_cast<dia::wifstream*>(&wif);
 
-		try
-		{
-			auto file_name = dynamic_cast<dia::wifstream&>(wif).get_file_name();
-			wof = std::wofstream(file_name + ".out", std::ios::binary);
-		}
-		catch (const std::bad_cast& e)
+		if (!file)
 		{
 #if STDIO_EXPERIMENTAL
-			wof = std::wofstream("diacstd.out", std::ios::binary);
+			process_text(wif, std::wcout);
+
+			if (!std::wcout)
+				throw_error(errors::output_file_error);
 #else
 			throw_error(errors::input_file_error);
 #endif
+			return;
 		}
 
+		auto wof = std::wofstream(file->get_file_name() + ".out", std::ios::binary);
+
+		if (!wof)
+			throw_error(errors::output_file_error);
+
+		process_text(wif, wof);
+
 		if (!wof)
 			throw_error(errors::output_file_error);
+	}
+
+	/**
+	 * Reads the stream and processes every word triplet it encounters\n
+	 * The stream is tokenized once, front to back, and only a bounded window of sentences is kept in memory, the result
+	 * is written into 'wof' as soon as the sentences are finished\n
+	 * A failed write is left in the state of 'wof' for the caller to check, the text is still read to its end
+	 *
+	 * @return Number of words of the text
+	 */
+	int64_t process_text(std::wistream& wif, std::wostream& wof)
+	{
+		PROFILE_FUNCTION();
+
+		text_word first, second;
+		text_token token;
 
-		auto mif = std::ifstream(model_name, std::ios::binary);
+		int64_t triplet_order_number = 0;
+		int64_t word_count = 0;
 
-		if (!mif)
-			throw_error(errors::model_error);
+		s_.potentially_foreign_words_.clear();
+		s_.pending_words_.clear();
+		s_.pending_formats_.clear();
+		s_.next_output_ = 0;
+		s_.input_finished_ = false;
 
-		mif.close();
+		text_tokenizer tokenizer(wif);
 
-		std::wstring first_w, second_w, third_w;
+		// Whitespace of the text is written after the word it follows, the one before the first word right away
+		wof << tokenizer.leading_whitespace();
 
-		auto triplet_order_number = 0;
+		s_.first_w_with_format_.clear();
+		s_.second_w_with_format_.clear();
 
-		wif >> first_w >> second_w;
-		auto word_count = 2;
+		// The first two words are not split, they are the context of the first word in question
+		if (tokenizer.next(token, false))
+		{
+			first = std::move(token.word);
+			s_.first_w_with_format_ = std::move(token.text);
+			s_.pending_formats_.push_back(std::move(token.whitespace));
+
+			word_count++;
+		}
 
-		s_.first_w_with_format_ = first_w;
-		s_.second_w_with_format_ = second_w;
+		if (tokenizer.next(token, false))
+		{
+			second = std::move(token.word);
+			s_.second_w_with_format_ = std::move(token.text);
+			s_.pending_formats_.push_back(std::move(token.whitespace));
+
+			word_count++;
+		}
 
-		prepare_words(word_wrapper{&first_w, &second_w});
+		auto first_w = first.word, second_w = second.word;
 		auto first_w_with_diacritics = most_common_tuple(first_w, second_w).first_w;
 
-		s_.result_words_.insert(std::pair<int, std::wstring>(triplet_order_number,
-		                                                  apply_previous_formatting(
-			                                                  s_.first_w_with_format_, first_w_with_diacritics)));
+		add_result(triplet_order_number, apply_previous_formatting(s_.first_w_with_format_, first_w_with_diacritics));
 		triplet_order_number++;
 
-		while (wif >> third_w)
+		while (tokenizer.next(token, true))
 		{
-			s_.third_w_with_format_ = third_w;
-			s_.carry_over_word_ = separate_punctuation(third_w);
+			s_.third_w_with_format_ = std::move(token.text);
+			s_.carry_over_word_ = std::move(token.punctuation);
+			s_.pending_formats_.push_back(std::move(token.whitespace));
 
 			word_count++;
 
-			do_triplet_iteration(first_w, second_w, third_w, triplet_order_number);
+			do_triplet_iteration(first, second, token.word, triplet_order_number, wof);
 			triplet_order_number++;
 
 			if (!s_.carry_over_word_.empty())
 			{
-				third_w = s_.carry_over_word_;
-
-				do_triplet_iteration(first_w, second_w, third_w, triplet_order_number);
+				do_triplet_iteration(first, second, text_word{s_.carry_over_word_, s_.carry_over_word_},
+				                     triplet_order_number, wof);
 
 				s_.carry_over_word_.clear();
 			}
 		}
 
-		wif.clear();
-		wif.seekg(0, std::ios_base::beg);
-
-		get_file_formatting(wif);
-
-		s_.word_futures_.clear();
-
-#ifdef DEBUG
-		if (result_words_.size() - 1 != total_words_read)
-		{
-			std::wcerr << total_words_read - result_words_.size() + 1 << L" words have been lost due to multi threading!\n";
-			throw_error(multithreading_error);
-		}
-#endif
+		flush_sentence(wof);
+		release_sentences(wof, true);
 
+		// Texts shorter than two words are weighed as two words long
 		if (!opt_.silence_ && s_.potentially_foreign_words_.size() / static_cast<double>(
-			word_count) >= 0.25)
-			std::wcerr << 100 * s_.potentially_foreign_words_.size() / static_cast<double>(word_count)
+			std::max<int64_t>(word_count, 2)) >= 0.25)
+			std::wcerr << 100 * s_.potentially_foreign_words_.size() / static_cast<double>(std::max<int64_t>(word_count, 2))
 				<< L"% of all words have not been found in the dictionary.\n"
-				<< L"It is possible that the file is not written in Czech!";
+				<< L"It is possible that the file is not written in Czech!\n";
 
-		prepare_words(word_wrapper{&first_w, &second_w});
+		first_w = first.word;
+		second_w = second.word;
 		auto third_w_with_diacritics = most_common_tuple(first_w, second_w).second_w;
 
-		s_.result_words_.insert(std::pair<int, std::wstring>(triplet_order_number,
-		                                                  apply_previous_formatting(
-			                                                  s_.second_w_with_format_, third_w_with_diacritics)));
+		add_result(triplet_order_number, apply_previous_formatting(s_.second_w_with_format_, third_w_with_diacritics));
 
-		print_result(wof);
+		s_.input_finished_ = true;
+		write_words(wof, triplet_order_number + 1);
 
-		s_.result_words_.clear();
-		s_.result_formats_.clear();
-		wof.close();
+		wof.flush();
+
+		return word_count;
 	}
 };
 
@@ -646,6 +1356,114 @@ void compress_one_file(const std::string& infilename, const std::string& outfile
 		<< (1.0 - file_size(outfilename) * 1.0 / total_read) * 100.0 << L"%\n";
 }
 
+/**
+ * Processes the files with up to 'streams' of them in flight at once, each with its own text processor sharing
+ * the word mapping and model of 'tp'\n
+ * The result of every file is written into the path plan_batch has chosen for it, a file that cannot be read
+ * or written is reported and skipped\n
+ * Reports the words and time of every file unless silenced and the totals of the batch
+ */
+void process_batch(text_processor& tp, user_options& opt, const std::vector<batch_file>& files, const size_t streams,
+                   const bool silence)
+{
+	std::atomic<size_t> next_file{0};
+	std::atomic<size_t> failed{0};
+	std::atomic<int64_t> total_words{0};
+	std::atomic<uint64_t> total_bytes{0};
+
+	std::mutex report_mutex;
+	auto slowest = 0.0;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	const auto process_files = [&](text_processor& processor)
+	{
+		for (auto i = next_file++; i < files.size(); i = next_file++)
+		{
+			const auto& [file_name, output_name] = files[i];
+
+			auto wif = dia::wifstream(file_name);
+			auto wof = wif ? std::wofstream(output_name, std::ios::binary) : std::wofstream();
+
+			if (!wif || !wof)
+			{
+				failed++;
+
+				std::lock_guard<std::mutex> lock(report_mutex);
+				std::wcerr << L"\tFile:\t" << file_name.c_str() << L"\tcould not be " << (wif ? L"written" : L"read")
+					<< L"\n";
+
+				continue;
+			}
+
+			const auto file_start = std::chrono::steady_clock::now();
+
+			const auto words = processor.process_text(wif, wof);
+
+			const auto milliseconds = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - file_start).count();
+
+			// The partial result of a file that could not be written is removed, so it is not taken for a finished one
+			if (!wof)
+			{
+				wof.close();
+
+				std::error_code error;
+				std::filesystem::remove(output_name, error);
+
+				failed++;
+
+				std::lock_guard<std::mutex> lock(report_mutex);
+				std::wcerr << L"\tFile:\t" << file_name.c_str() << L"\tcould not be written\n";
+
+				continue;
+			}
+
+			std::error_code error;
+			const auto bytes = std::filesystem::file_size(file_name, error);
+
+			total_words += words;
+			total_bytes += error ? 0 : bytes;
+
+			std::lock_guard<std::mutex> lock(report_mutex);
+
+			slowest = std::max(slowest, milliseconds);
+
+			if (!silence)
+				std::wcerr << L"\tFile:\t" << file_name.c_str() << L"\t" << words << L" words\t" << milliseconds
+					<< L" ms\t" << (milliseconds > 0 ? words * 1000.0 / milliseconds : 0.0) << L" words/s\n";
+		}
+	};
+
+	// The calling thread processes files as well, the other streams read their files on their own threads, while
+	// the sentences of all of them are decoded by the shared workers
+	std::vector<std::unique_ptr<text_processor>> processors;
+	std::vector<std::thread> threads;
+
+	for (size_t i = 1; i < std::min(streams, files.size()); i++)
+	{
+		processors.push_back(std::make_unique<text_processor>(opt, tp.data()));
+		threads.emplace_back(process_files, std::ref(*processors.back()));
+	}
+
+	process_files(tp);
+
+	for (auto& thread : threads)
+		thread.join();
+
+	const auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).
+		count();
+	const auto seconds = milliseconds / 1000;
+
+	std::wcerr << L"Batch:\n"
+		<< L"\tFiles:\t\t" << files.size() - failed << L" processed, " << failed << L" failed, "
+		<< std::min(streams, files.size()) << L" at once\n"
+		<< L"\tLength:\t\t" << total_words << L" words, " << total_bytes / 1024 << L" KiB\n"
+		<< L"\tTime:\t\t" << milliseconds << L" ms, slowest document " << slowest << L" ms\n"
+		<< L"\tThroughput:\t" << (seconds > 0 ? total_words / seconds : 0.0) << L" words/s, "
+		<< (seconds > 0 ? total_bytes / 1048576.0 / seconds : 0.0) << L" MiB/s\n";
+}
+
 // ASSUMES UTF-8 
 int main(int argc, char** argv)
 {
@@ -654,7 +1472,13 @@ int main(int argc, char** argv)
 #endif
 
 	SetConsoleOutputCP(65001);
+#ifdef _WIN32
+	// The text is passed through byte for byte, as it is with files
+	(void)_setmode(_fileno(stdin), _O_BINARY);
+	(void)_setmode(_fileno(stdout), _O_BINARY);
+#endif
 	(void)std::ios_base::sync_with_stdio(false);
+	(void)std::wcin.imbue(std::locale(std::locale::empty(), new std::codecvt_utf8<wchar_t>));
 	(void)std::wcout.imbue(std::locale(std::locale::empty(), new std::codecvt_utf8<wchar_t>));
 	(void)std::wcerr.imbue(std::locale(std::locale::empty(), new std::codecvt_utf8<wchar_t>));
 	(void)std::locale::global(std::locale(std::locale::empty(), new std::codecvt_utf8<wchar_t>));
@@ -662,7 +1486,17 @@ int main(int argc, char** argv)
 	auto conflict = false;
 	auto silence = false;
 	auto memory_map = false;
-	auto file_less = true;
+	auto demo = false;
+	auto format = model_format::automatic;
+	auto backend = dictionary_backend::hashed;
+	size_t candidate_cap = 0;
+	size_t variant_cache_megabytes = default_variant_cache_megabytes;
+	size_t thread_count = 0;
+	auto pin_threads = false;
+	auto batch = false;
+	std::string file_name;
+	std::vector<std::string> inputs;
+	std::string output_name;
 
 	if (argc >= 2)
 	{
@@ -671,79 +1505,94 @@ int main(int argc, char** argv)
 			assert(argc == 2);
 
 			std::wcerr << L"*** Diac - a tool for diacritics ***\n"
-				<< L"\n(Note that the '-m' option does not yield any notable performance improvements and should only be used on systems with HDD)\n"
+				<< L"\n(The model is memory mapped, the '-m' option additionally preloads it into the system file cache before processing)\n"
 				<< L"\tUsage:\t 'diac -i' for installation.\n"
 				<< L"\t\t'diac -[scm] [filename]' for silent, conflict resolving or memory mapping modes.\n"
+				<< L"\t\t'diac [-o output] [filename]' to write the result into the output file ('-' for the standard output), the standard input is read without a filename.\n"
+				<< L"\t\t'diac -b [-o directory] [filename|directory|pattern|@list] ...' to process many files with the model loaded once, several at a time (the paths of the files are mirrored under the output directory).\n"
+				<< L"\t\t'diac -f [auto|raw|varint|columnar] [filename]' to select the model format (auto prefers the columnar, then the compressed model).\n"
+				<< L"\t\t'diac --convert-model [varint|columnar]' to convert the installed model into the compressed or columnar format.\n"
+				<< L"\t\t'diac --dictionary [hash|dawg] [filename]' to select the dictionary the word variants are looked up in (the dawg replaces the word mapping and the folded index, saving memory, but does without the decision tables).\n"
+				<< L"\t\t'diac -k [count] [filename]' to combine only the given number of the most frequent variants of every context word (0 for the exact search).\n"
+				<< L"\t\t'diac --variant-cache [MiB] [filename]' to limit the memory of the cache of word variants (0 disables it).\n"
+				<< L"\t\t'diac -j [count] [--pin] [filename]' to set the number of worker threads (0 for one per hardware thread) and optionally bind each to its own core.\n"
+				<< L"\t\t'diac --benchmark' to measure the context matching kernels and the variant lookups.\n"
 				<< L"\t\t'diac -[hc] [filename]' for Huffman compression of said file.\n"
 				<< L"\t\t'diac -[hd] [filename]' for Huffman decompression of said file.\n\n";
 
 			return 0;
 		}
-		if (strcmp(argv[1], "-d") == 0 ||
-			strcmp(argv[1], "--demo") == 0)
+		if (strcmp(argv[1], "-i") == 0 ||
+			strcmp(argv[1], "--install") == 0)
 		{
 			assert(argc == 2);
 
-			auto opt = user_options(false, false);
-			auto tp = text_processor(opt);
+			std::wcerr << L"Decompressing...\n";
+
+			if (std::ifstream(std::string(varint_model_name) + ".hzip"))
+				decompress_one_file(std::string(varint_model_name) + ".hzip", varint_model_name);
+			else
+				decompress_one_file("_diac_model.hzip", model_name);
 
-			std::wcerr << L"Demo:\n";
+			std::wcerr << L"Indexing...\n";
 
-			for (auto i = 1; i <= 5; i++)
-			{
-				auto wif = dia::wifstream("demo0" + std::to_string(i) + ".txt");
+			if (std::ifstream(offset_model_name))
+				save_binary_offsets(load_compressed_model(offset_model_name), binary_offset_model_name);
 
-				if (wif)
-				{
-					std::wcerr << L"Running demo no. " << i << " out of " << 5 << "\n";
+			save_dictionary_image(dictionary_name, binary_dictionary_name);
 
-					tp.process_text(wif);
+			const auto wm = load_dictionary(binary_dictionary_name, dictionary_name);
 
-					auto word_count = 0;
-					std::vector<std::pair<std::wstring, std::wstring>> diff_words;
-					auto reference_wif = dia::wifstream("demo0" + std::to_string(i) + "_ref.txt");
-					auto output_wif = dia::wifstream("demo0" + std::to_string(i) + ".txt.out");
+			const auto model = load_model(model_format::automatic);
 
-					auto diff_count = diff(reference_wif, output_wif, word_count, diff_words);
+			save_folded_index(wm, folded_index_name);
+			save_dawg_dictionary(wm, dawg_dictionary_name);
+			save_count_tables(*model, wm.size(), count_tables_name);
+			save_decision_tables(*model, wm, load_folded_index(folded_index_name, wm), decision_tables_name);
+			save_bloom_filter(*model, wm.size(), bloom_filter_name);
 
-					std::wcerr << L"\tFile:\tdemo0" << i << ".txt\n"
-						<< L"\t\tTotal length:\t" << word_count << " words\n"
-						<< L"\t\tDifferences:\t" << diff_count << " words\n"
-						<< L"\t\tAccuracy:\t" << 100 * (static_cast<double>(word_count) - diff_count) / static_cast<
-							double>(word_count) << "%\n";
+			std::wcerr << L"Installation Successful!\n";
 
-					if (diff_count > 0)
-					{
-						std::wcerr << L"\t\tList of differing words:\n";
+			return 0;
+		}
+		if (strcmp(argv[1], "--convert-model") == 0)
+		{
+			assert(argc == 3);
 
-						for (auto&& pair : diff_words)
-						{
-							std::wcerr << L"\t\t\t" << pair.first << L"\t" << pair.second << L"\n";
-						}
-					}
-				}
-				else
-					throw_error(errors::input_file_error);
+			const auto target = parse_model_format(argv[2]);
 
-				wif.close();
-			}
+			if (target != model_format::varint && target != model_format::columnar)
+				throw_error(errors::invalid_option_error);
 
-#if PROFILING
-			instrumentor::get().end_session();
-#endif
+			const auto output = target == model_format::varint ? varint_model_name : columnar_model_name;
+
+			std::wcerr << L"Converting...\n";
+
+			if (target == model_format::varint)
+				convert_model_to_varint(model_name, load_offset_table(binary_offset_model_name, offset_model_name),
+				                        output);
+			else
+				convert_model_to_columnar(model_name, load_offset_table(binary_offset_model_name, offset_model_name),
+				                          output);
+
+			std::wcerr << L"Model converted successfully!\n"
+				<< L"Output:\t" << output << L"\n";
 
 			return 0;
 		}
-		if (strcmp(argv[1], "-i") == 0 ||
-			strcmp(argv[1], "--install") == 0)
+		if (strcmp(argv[1], "--benchmark") == 0)
 		{
 			assert(argc == 2);
 
-			std::wcerr << L"Decompressing...\n";
+			run_kernel_benchmark();
 
-			decompress_one_file("_diac_model.hzip", model_name);
+			if (std::ifstream(binary_dictionary_name) || std::ifstream(dictionary_name))
+			{
+				const auto wm = load_dictionary(binary_dictionary_name, dictionary_name);
 
-			std::wcerr << L"Installation Successful!\n";
+				run_dictionary_benchmark(wm, load_folded_index(folded_index_name, wm),
+				                         load_dawg_dictionary(dawg_dictionary_name, wm));
+			}
 
 			return 0;
 		}
@@ -779,156 +1628,294 @@ int main(int argc, char** argv)
 
 			return 0;
 		}
+	}
 
-		if (strcmp(argv[1], "-c") == 0 ||
-			strcmp(argv[1], "--conflict") == 0)
-		{
+	for (auto i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+
+		if (argument == "-d" || argument == "--demo")
+			demo = true;
+		else if (argument == "--silent")
+			silence = true;
+		else if (argument == "--conflict")
 			conflict = true;
+		else if (argument == "--memory")
+			memory_map = true;
+		else if (argument == "-f" || argument == "--model-format")
+		{
+			if (++i == argc)
+				throw_error(errors::invalid_option_error);
+
+			format = parse_model_format(argv[i]);
+		}
+		else if (argument == "--dictionary")
+		{
+			if (++i == argc)
+				throw_error(errors::invalid_option_error);
 
-			if (argc >= 3)
-				file_less = false;
+			backend = parse_dictionary_backend(argv[i]);
+		}
+		else if (argument == "-k" || argument == "--top-k")
+		{
+			if (++i == argc)
+				throw_error(errors::invalid_option_error);
 
-			if (strcmp(argv[2], "-s") == 0 ||
-				strcmp(argv[2], "--silent") == 0)
+			try
 			{
-				silence = true;
-				if (argc == 4)
-					file_less = false;
+				candidate_cap = std::stoul(argv[i]);
 			}
-			else if (strcmp(argv[2], "-m") == 0 ||
-				strcmp(argv[2], "--memory") == 0)
+			catch (const std::exception&)
 			{
-				memory_map = true;
-				if (argc == 4)
-					file_less = false;
+				throw_error(errors::invalid_option_error);
 			}
-			
-			if (strcmp(argv[3], "-s") == 0 ||
-				strcmp(argv[3], "--silent") == 0)
+		}
+		else if (argument == "--variant-cache")
+		{
+			if (++i == argc)
+				throw_error(errors::invalid_option_error);
+
+			try
 			{
-				silence = true;
-				if (argc == 5)
-					file_less = false;
+				variant_cache_megabytes = std::stoul(argv[i]);
 			}
-			else if (strcmp(argv[3], "-m") == 0 ||
-				strcmp(argv[3], "--memory") == 0)
+			catch (const std::exception&)
 			{
-				memory_map = true;
-				if (argc == 5)
-					file_less = false;
+				throw_error(errors::invalid_option_error);
 			}
 		}
-		else if (strcmp(argv[1], "-s") == 0 ||
-			strcmp(argv[1], "--silent") == 0)
+		else if (argument == "-j" || argument == "--jobs")
 		{
-			silence = true;
-
-			if (argc >= 3)
-				file_less = false;
+			if (++i == argc)
+				throw_error(errors::invalid_option_error);
 
-			if (strcmp(argv[2], "-c") == 0 ||
-				strcmp(argv[2], "--conflict") == 0)
+			try
 			{
-				conflict = true;
-				if (argc == 4)
-					file_less = false;
+				thread_count = std::stoul(argv[i]);
 			}
-			else if (strcmp(argv[2], "-m") == 0 ||
-				strcmp(argv[2], "--memory") == 0)
+			catch (const std::exception&)
 			{
-				memory_map = true;
-				if (argc == 4)
-					file_less = false;
+				throw_error(errors::invalid_option_error);
 			}
+		}
+		else if (argument == "--pin")
+			pin_threads = true;
+		else if (argument == "-b" || argument == "--batch")
+			batch = true;
+		else if (argument == "-o" || argument == "--output")
+		{
+			if (++i == argc)
+				throw_error(errors::invalid_option_error);
 
-			if (strcmp(argv[3], "-c") == 0 ||
-				strcmp(argv[3], "--conflict") == 0)
-			{
-				conflict = true;
-				if (argc == 5)
-					file_less = false;
-			}
-			else if (strcmp(argv[3], "-m") == 0 ||
-				strcmp(argv[3], "--memory") == 0)
+			output_name = argv[i];
+		}
+		else if (argument.size() > 1 && argument[0] == '-')
+		{
+			// Bundled single letter flags, e.g. '-scm'
+			for (auto flag : argument.substr(1))
 			{
-				memory_map = true;
-				if (argc == 5)
-					file_less = false;
+				switch (flag)
+				{
+				case 's':
+					silence = true;
+					break;
+				case 'c':
+					conflict = true;
+					break;
+				case 'm':
+					memory_map = true;
+					break;
+				default:
+					throw_error(errors::invalid_option_error);
+				}
 			}
 		}
-		else if (strcmp(argv[1], "-cs") == 0 ||
-			strcmp(argv[1], "-sc") == 0)
+		else
 		{
-			conflict = true;
-			silence = true;
+			file_name = argument;
+			inputs.push_back(argument);
+		}
+	}
+
+	auto opt = user_options(silence, conflict, memory_map, format, backend, candidate_cap);
+
+	shared_variants.set_capacity(variant_cache_megabytes << 20);
+	shared_workers = std::make_unique<work_stealing_pool>(thread_count, pin_threads);
+
+	if (demo)
+	{
+		// With capped candidates every demo is first run exactly as well, so that the trade-off can be reported,
+		// both runs search the blocks, the decision tables would answer most words the same way in either of them
+		auto demo_opt = user_options(silence, conflict, memory_map, format, backend, candidate_cap, candidate_cap == 0);
+		auto tp = text_processor(demo_opt);
+		std::unique_ptr<text_processor> exact_tp;
 
-			if (argc == 3)
-				file_less = false;
+		if (candidate_cap > 0)
+		{
+			auto exact_opt = user_options(silence, conflict, memory_map, format, backend, 0, false);
+			exact_tp = std::make_unique<text_processor>(exact_opt, tp.data());
 		}
-		else if (strcmp(argv[1], "-m") == 0 ||
-			strcmp(argv[1], "--memory") == 0)
+
+		// Processes the demo and compares it with its reference, returns the number of differing words
+		const auto run_demo = [](text_processor& processor, const int i, int& word_count, double& milliseconds,
+		                         std::vector<std::pair<std::wstring, std::wstring>>& diff_words)
 		{
-			memory_map = true;
+			auto wif = dia::wifstream("demo0" + std::to_string(i) + ".txt");
 
-			if (argc >= 3)
-				file_less = false;
+			if (!wif)
+				throw_error(errors::input_file_error);
 
-			if (strcmp(argv[2], "-c") == 0 ||
-				strcmp(argv[2], "--conflict") == 0)
-			{
-				conflict = true;
-				if (argc == 4)
-					file_less = false;
-			}
-			else if (strcmp(argv[2], "-s") == 0 ||
-				strcmp(argv[2], "--silent") == 0)
-			{
-				silence = true;
-				if (argc == 4)
-					file_less = false;
-			}
+			const auto start = std::chrono::steady_clock::now();
 
-			if (strcmp(argv[3], "-c") == 0 ||
-				strcmp(argv[3], "--conflict") == 0)
-			{
-				conflict = true;
-				if (argc == 5)
-					file_less = false;
-			}
-			else if (strcmp(argv[3], "-s") == 0 ||
-				strcmp(argv[3], "--silent") == 0)
+			processor.process_text(wif);
+
+			milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			wif.close();
+
+			word_count = 0;
+			diff_words.clear();
+
+			auto reference_wif = dia::wifstream("demo0" + std::to_string(i) + "_ref.txt");
+			auto output_wif = dia::wifstream("demo0" + std::to_string(i) + ".txt.out");
+
+			return diff(reference_wif, output_wif, word_count, diff_words);
+		};
+
+		auto total_words = 0, total_diffs = 0, exact_diffs = 0;
+		auto total_time = 0.0, slowest = 0.0, exact_time = 0.0, exact_slowest = 0.0;
+
+		std::wcerr << L"Demo:\n";
+
+		for (auto i = 1; i <= 5; i++)
+		{
+			std::wcerr << L"Running demo no. " << i << " out of " << 5 << "\n";
+
+			auto word_count = 0;
+			std::vector<std::pair<std::wstring, std::wstring>> diff_words;
+			double exact_milliseconds = 0, milliseconds = 0;
+
+			auto exact_diff_count = 0;
+
+			if (exact_tp)
+				exact_diff_count = run_demo(*exact_tp, i, word_count, exact_milliseconds, diff_words);
+
+			const auto diff_count = run_demo(tp, i, word_count, milliseconds, diff_words);
+
+			total_words += word_count;
+			total_diffs += diff_count;
+			exact_diffs += exact_diff_count;
+			total_time += milliseconds;
+			exact_time += exact_milliseconds;
+			slowest = std::max(slowest, milliseconds);
+			exact_slowest = std::max(exact_slowest, exact_milliseconds);
+
+			std::wcerr << L"\tFile:\tdemo0" << i << ".txt\n"
+				<< L"\t\tTotal length:\t" << word_count << " words\n"
+				<< L"\t\tDifferences:\t" << diff_count << " words\n"
+				<< L"\t\tAccuracy:\t" << 100 * (static_cast<double>(word_count) - diff_count) / static_cast<
+					double>(word_count) << "%\n"
+				<< L"\t\tTime:\t\t" << milliseconds << " ms\n";
+
+			if (exact_tp)
+				std::wcerr << L"\t\tExact search:\t" << 100 * (static_cast<double>(word_count) - exact_diff_count) /
+					static_cast<double>(word_count) << "% in " << exact_milliseconds << " ms\n";
+
+			if (diff_count > 0)
 			{
-				silence = true;
-				if (argc == 5)
-					file_less = false;
+				std::wcerr << L"\t\tList of differing words:\n";
+
+				for (auto&& pair : diff_words)
+				{
+					std::wcerr << L"\t\t\t" << pair.first << L"\t" << pair.second << L"\n";
+				}
 			}
 		}
-		else if (strcmp(argv[1], "-mcs") == 0 ||
-			strcmp(argv[1], "-cms") == 0 ||
-			strcmp(argv[1], "-csm") == 0 || 
-			strcmp(argv[1], "-scm") == 0 || 
-			strcmp(argv[1], "-msc") == 0)
+
+		if (total_words > 0)
 		{
-			conflict = true;
-			silence = true;
-			memory_map = true;
-			
-			if (argc == 3)
-				file_less = false;
+			std::wcerr << L"Summary:\n"
+				<< L"\tCandidates:\t";
+
+			if (candidate_cap > 0)
+				std::wcerr << L"top " << candidate_cap << L" per context word\n";
+			else
+				std::wcerr << L"exact\n";
+
+			std::wcerr << L"\tAccuracy:\t" << 100 * (static_cast<double>(total_words) - total_diffs) / total_words
+				<< L"%\n"
+				<< L"\tTime:\t\t" << total_time << L" ms, slowest document " << slowest << L" ms\n";
+
+			if (exact_tp)
+				std::wcerr << L"\tExact search:\t" << 100 * (static_cast<double>(total_words) - exact_diffs) / total_words
+					<< L"% in " << exact_time << L" ms, slowest document " << exact_slowest << L" ms\n";
+
+			if (shared_variants.enabled())
+			{
+				const auto statistics = shared_variants.statistics();
+				const auto lookups = statistics.hits + statistics.misses;
+
+				std::wcerr << L"\tVariant cache:\t" << statistics.hits << L" hits, " << statistics.misses << L" misses ("
+					<< (lookups > 0 ? 100.0 * statistics.hits / lookups : 0.0) << L"% hit rate), "
+					<< statistics.entries << L" words in " << statistics.bytes / 1024 << L" KiB, "
+					<< statistics.evictions << L" evicted\n";
+			}
 		}
-		else
-			file_less = false;
+
+#if PROFILING
+		instrumentor::get().end_session();
+#endif
+
+		return 0;
 	}
 
+	// Several inputs, directories, patterns and lists are processed as one batch with the model loaded once
+	if (batch || inputs.size() > 1)
+	{
+		if (inputs.empty() || output_name == "-")
+			throw_error(errors::invalid_option_error);
+
+		std::vector<std::string> files;
+
+		for (const auto& input : inputs)
+			add_batch_input(input, files);
+
+		// '-o' names the directory of the results, no two files may share a result as the streams write at once
+		const auto batch_files = plan_batch(files, output_name);
+
+		auto tp = text_processor(opt);
+
+		// Every conflict is resolved by the user, so the documents are processed one at a time
+		process_batch(tp, opt, batch_files, conflict ? 1 : shared_workers->size(), silence);
+
+#if PROFILING
+		instrumentor::get().end_session();
+#endif
+
+		return 0;
+	}
 
-	auto opt = user_options(silence, conflict);
 	auto tp = text_processor(opt);
 
-	if (file_less)
+	// '-o' redirects the output, '-' stands for the standard output
+	std::wofstream output_file;
+
+	if (!output_name.empty() && output_name != "-")
+	{
+		output_file = std::wofstream(output_name, std::ios::binary);
+
+		if (!output_file)
+			throw_error(errors::output_file_error);
+	}
+
+	if (file_name.empty())
 	{
 		/// STDIN TO STDOUT MODE
 #if STDIO_EXPERIMENTAL
-		tp.process_text(std::wcin);
+		if (output_file.is_open())
+			tp.process_text(std::wcin, output_file);
+		else
+			tp.process_text(std::wcin, std::wcout);
 #else
 		throw_error(errors::input_file_error);
 #endif
@@ -936,16 +1923,25 @@ int main(int argc, char** argv)
 	else
 	{
 		/// FILE TO FILE MODE
-		auto wif = dia::wifstream(argv[argc - 1]);
+		auto wif = dia::wifstream(file_name);
 
-		if (wif)
-			tp.process_text(wif);
-		else
+		if (!wif)
 			throw_error(errors::input_file_error);
 
+		if (output_file.is_open())
+			tp.process_text(wif, output_file);
+		else if (output_name == "-")
+			tp.process_text(wif, std::wcout);
+		else
+			tp.process_text(wif);
+
 		wif.close();
 	}
 
+	// process_text leaves the write errors in the state of the output stream
+	if (output_file.is_open() ? !output_file : !std::wcout)
+		throw_error(errors::output_file_error);
+
 #if PROFILING
 	instrumentor::get().end_session();
 #endif
@@ -1,5 +1,14 @@
 #pragma once
 
 const char* model_name = "_diac_model";
+const char* varint_model_name = "_diac_model.vb";
+const char* columnar_model_name = "_diac_model.col";
 const char* offset_model_name = "_diac_offsets";
-const char* dictionary_name = "_diac_dictionary";
\ No newline at end of file
+const char* binary_offset_model_name = "_diac_offsets.bin";
+const char* dictionary_name = "_diac_dictionary";
+const char* binary_dictionary_name = "_diac_dictionary.bin";
+const char* count_tables_name = "_diac_counts.bin";
+const char* folded_index_name = "_diac_folded.bin";
+const char* dawg_dictionary_name = "_diac_dictionary.dawg";
+const char* decision_tables_name = "_diac_decisions.bin";
+const char* bloom_filter_name = "_diac_bloom.bin";
\ No newline at end of file
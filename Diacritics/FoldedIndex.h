@@ -0,0 +1,262 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LookupStructures.h"
+#include "MemoryMap.h"
+#include "WideCharUtilities.h"
+
+/**
+ * Header of the folded index image, the header is followed by these sections:\n
+ * keys - folded_key[key_count], one per distinct folded form\n
+ * slots - UINT32[slot_count], index of the key hashed into the slot + 1 (0 for an empty slot), linear probing\n
+ * ids - INT32[id_count], int codes of the words of every key, ordered as the words themselves
+ */
+struct folded_index_header
+{
+	char magic[8];
+	uint32_t word_count;
+	uint32_t key_count;
+	uint32_t slot_count;
+	uint32_t id_count;
+};
+
+/**
+ * Words sharing one folded form occupy ids[first, first + length)
+ */
+struct folded_key
+{
+	uint32_t first;
+	uint32_t length;
+};
+
+/**
+ * Number of dictionary variants of a word - the words with a single variant (or none) are resolved without the model
+ */
+enum class ambiguity_class
+{
+	none,
+	single,
+	ambiguous
+};
+
+static const char folded_index_magic[8] = {'D', 'I', 'A', 'C', 'F', 'L', 'D', '1'};
+
+/**
+ * Maps the folded form of a word (every letter with diacritics replaced by its base letter) to the int codes
+ * of all dictionary words with that form, so the variants of a word are found by a single hash lookup\n
+ * The image is either memory mapped from a prebuilt file or built in memory from the dictionary
+ */
+class folded_index
+{
+	mem_map mapped_image_;
+	std::vector<char> owned_image_;
+
+	const folded_index_header* header_ = nullptr;
+	const folded_key* keys_ = nullptr;
+	const uint32_t* slots_ = nullptr;
+	const int32_t* ids_ = nullptr;
+
+	void attach(const char* image, const size_t size, const size_t word_count)
+	{
+		if (!image || size < sizeof(folded_index_header))
+			return;
+
+		const auto header = reinterpret_cast<const folded_index_header*>(image);
+
+		if (memcmp(header->magic, folded_index_magic, sizeof folded_index_magic) != 0 ||
+			header->word_count != word_count || header->slot_count == 0 ||
+			(header->slot_count & (header->slot_count - 1)) != 0 || header->key_count >= header->slot_count)
+			return;
+
+		const size_t keys_size = static_cast<size_t>(header->key_count) * sizeof(folded_key);
+		const size_t slots_size = static_cast<size_t>(header->slot_count) * sizeof(uint32_t);
+		const size_t ids_size = static_cast<size_t>(header->id_count) * sizeof(int32_t);
+
+		if (sizeof(folded_index_header) + keys_size + slots_size + ids_size > size)
+			return;
+
+		auto section = image + sizeof(folded_index_header);
+
+		keys_ = reinterpret_cast<const folded_key*>(section);
+		section += keys_size;
+		slots_ = reinterpret_cast<const uint32_t*>(section);
+		section += slots_size;
+		ids_ = reinterpret_cast<const int32_t*>(section);
+
+		header_ = header;
+	}
+
+	/**
+	 * @return True if the dictionary word folds into 'folded'
+	 */
+	static bool folds_into(const std::wstring_view word, const std::wstring_view folded)
+	{
+		if (word.size() != folded.size())
+			return false;
+
+		for (size_t i = 0; i < word.size(); i++)
+			if (fold_letter(word[i]) != folded[i])
+				return false;
+
+		return true;
+	}
+
+	/**
+	 * Folds the word into 'folded' and looks up its key
+	 *
+	 * @return The key of the folded form, nullptr if no dictionary word has it
+	 */
+	const folded_key* find_key(const word_mapping& wm, const std::wstring_view word, std::wstring& folded) const
+	{
+		folded.assign(word);
+
+		for (auto& c : folded)
+			c = fold_letter(c);
+
+		const auto mask = header_->slot_count - 1;
+
+		for (auto slot = hash_word(folded, 0) & mask;; slot = (slot + 1) & mask)
+		{
+			const auto key_number = slots_[slot];
+
+			if (key_number == 0)
+				return nullptr;
+
+			const auto& key = keys_[key_number - 1];
+
+			if (folds_into(wm.int_to_word(ids_[key.first]), folded))
+				return &key;
+		}
+	}
+
+	/**
+	 * @return True if the variant keeps every letter of the word that already has diacritics
+	 */
+	static bool keeps_diacritics(const std::wstring_view variant, const std::wstring_view word,
+	                             const std::wstring_view folded)
+	{
+		for (size_t i = 0; i < word.size(); i++)
+			if (folded[i] != word[i] && variant[i] != word[i])
+				return false;
+
+		return true;
+	}
+
+public:
+	folded_index() = default;
+
+	/**
+	 * The index stays empty if the image is not valid or was built for a dictionary of another size
+	 */
+	folded_index(mem_map&& mm, const size_t word_count) : mapped_image_(std::move(mm))
+	{
+		attach(mapped_image_.data(), mapped_image_.size(), word_count);
+	}
+
+	folded_index(std::vector<char>&& image, const size_t word_count) : owned_image_(std::move(image))
+	{
+		attach(owned_image_.data(), owned_image_.size(), word_count);
+	}
+
+	/**
+	 * Collects the int codes of all dictionary variants of a word - the word itself and every word that differs
+	 * from it only by diacritics added to its letters (letters that already have diacritics stay as they are)\n
+	 * The codes are ordered as the variant words themselves
+	 */
+	void variants(const word_mapping& wm, const std::wstring_view word, std::vector<int32_t>& ids) const
+	{
+		ids.clear();
+
+		if (!header_ || word.empty())
+			return;
+
+		thread_local std::wstring folded;
+
+		const auto key = find_key(wm, word, folded);
+
+		if (!key)
+			return;
+
+		for (auto id = ids_ + key->first; id != ids_ + key->first + key->length; ++id)
+			if (keeps_diacritics(wm.int_to_word(*id), word, folded))
+				ids.push_back(*id);
+	}
+
+	/**
+	 * Classifies the word by the number of its dictionary variants without collecting them, the length of the key
+	 * tells the class of a folded form, only words that already have some diacritics need their variants checked
+	 *
+	 * @param id Set to the int code of the variant for the single variant words
+	 */
+	ambiguity_class ambiguity(const word_mapping& wm, const std::wstring_view word, int32_t& id) const
+	{
+		if (!header_ || word.empty())
+			return ambiguity_class::none;
+
+		thread_local std::wstring folded;
+
+		const auto key = find_key(wm, word, folded);
+
+		if (!key)
+			return ambiguity_class::none;
+
+		auto found = 0;
+
+		for (auto variant = ids_ + key->first; variant != ids_ + key->first + key->length && found < 2; ++variant)
+		{
+			if (keeps_diacritics(wm.int_to_word(*variant), word, folded))
+			{
+				id = *variant;
+				found++;
+			}
+		}
+
+		return found == 0 ? ambiguity_class::none : found == 1 ? ambiguity_class::single : ambiguity_class::ambiguous;
+	}
+
+	/**
+	 * Looks up the key of a word that has no diacritics, keys are numbered from 0 to key_count() - 1
+	 *
+	 * @return False if no dictionary word folds into the word
+	 */
+	bool key_of(const word_mapping& wm, const std::wstring_view word, uint32_t& key_number) const
+	{
+		if (!header_ || word.empty())
+			return false;
+
+		thread_local std::wstring folded;
+
+		const auto key = find_key(wm, word, folded);
+
+		if (!key)
+			return false;
+
+		key_number = static_cast<uint32_t>(key - keys_);
+
+		return true;
+	}
+
+	/**
+	 * @return Int codes of the words of the key, ordered as the words themselves
+	 */
+	const int32_t* key_ids(const uint32_t key_number, uint32_t& length) const
+	{
+		length = keys_[key_number].length;
+
+		return ids_ + keys_[key_number].first;
+	}
+
+	size_t key_count() const
+	{
+		return header_ ? header_->key_count : 0;
+	}
+
+	bool empty() const
+	{
+		return header_ == nullptr;
+	}
+};
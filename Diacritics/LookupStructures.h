@@ -2,95 +2,270 @@
 #include <utility>
 #include <unordered_map>
 #include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "MemoryMap.h"
 
 /**
- * A mutable unordered bimap for std::wstring and int values
+ * Header of the binary dictionary image, the header is followed by these sections:\n
+ * word_offsets - UINT32[word_count + 2], word with the int code i spans pool[word_offsets[i], word_offsets[i + 1])\n
+ * displacements - UINT32[bucket_count], displacement of every bucket of the perfect hash\n
+ * slots - UINT32[slot_count], int code of the word hashed into the slot (0 for an empty slot)\n
+ * Images without buckets use the slots as an open addressing table with linear probing instead of the perfect hash\n
+ * pool - wchar_t[pool_length], all words stored back to back without separators
  */
-class mutable_word_mapping
+struct dictionary_file_header
 {
-public:
-	std::unordered_map<std::wstring, int> word_to_int_map;
-	std::unordered_map<int, const std::wstring> int_to_word_map;
+	char magic[8];
+	uint32_t char_size;
+	uint32_t word_count;
+	uint32_t pool_length;
+	uint32_t bucket_count;
+	uint32_t slot_count;
+	uint32_t seed;
+};
 
-	mutable_word_mapping() = default;
+static const char dictionary_file_magic[8] = {'D', 'I', 'A', 'C', 'D', 'I', 'C', '1'};
 
-	void insert(std::wstring&& word, int number)
+/**
+ * 64-bit FNV-1a with a final avalanche step, the seed allows rehashing when a perfect hash cannot be built
+ */
+inline uint64_t hash_word(const std::wstring_view word, const uint64_t seed)
+{
+	auto h = 0xcbf29ce484222325ULL ^ seed;
+
+	for (auto c : word)
 	{
-		const auto it = word_to_int_map.emplace(std::pair<std::wstring, int>(word, number));
-		int_to_word_map.emplace(std::pair<int, const std::wstring>(number, it.first->first));
-#ifdef DEBUG
-		std::wcout << L"Word To Int Map address: " << &(word_to_int_map_.cbegin()->first)
-			<< L", Word To Int Map word: " << (word_to_int_map_.cbegin()->first) << L"\n";
-		std::wcout << L"Int To Word Map address: " << int_to_word_map_.cbegin()->second
-			<< L", Int To Word Map word: " << *(int_to_word_map_.cbegin()->second) << L"\n";
-#endif
+		h ^= static_cast<uint64_t>(c);
+		h *= 0x100000001b3ULL;
 	}
 
-	int word_to_int(std::wstring& word)
-	{
-		const auto return_val = word_to_int_map[word];
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
 
-		if (return_val)
-			return return_val;
+	return h;
+}
 
-		return 0;
+/**
+ * Slot of a word in the perfect hash table - the bucket selects a displacement, which is split into
+ * a multiple of the word's probe step and a plain shift (CHD style displacement pairs)
+ */
+struct perfect_hash
+{
+	uint64_t bucket;
+	uint64_t first_slot;
+	uint64_t step;
+
+	perfect_hash(const uint64_t hash, const uint32_t bucket_count, const uint32_t slot_count)
+	{
+		auto mixed = hash * 0x9e3779b97f4a7c15ULL;
+		mixed ^= mixed >> 29;
+
+		bucket = (hash >> 32) % bucket_count;
+		first_slot = (hash & 0xffffffffULL) % slot_count;
+		step = slot_count > 1 ? mixed % (slot_count - 1) + 1 : 1;
 	}
 
-	const std::wstring& int_to_word(const int number)
+	[[nodiscard]] uint64_t slot(const uint32_t displacement, const uint32_t slot_count) const
 	{
-		return int_to_word_map[number];
+		const uint64_t multiplier = displacement / slot_count;
+		const uint64_t shift = displacement % slot_count;
+
+		return (first_slot + multiplier * step + shift) % slot_count;
 	}
 };
 
 /**
- * An immutable unordered bimap for std::wstring and int values\n
- * Instances are created by making a copy of an existing mutable_word_mapping object
+ * An immutable bimap for std::wstring and int values, backed by a binary dictionary image\n
+ * The image is either memory mapped from a prebuilt file (words are looked up through a perfect hash that keeps
+ * about 98 % of its slots occupied) or built in memory from the text dictionary (open addressing table),
+ * words are returned as views into a single string pool
  */
 class word_mapping
 {
-	const std::unordered_map<std::wstring, int> word_to_int_map_;
-	const std::unordered_map<int, const std::wstring> int_to_word_map_;
+	mem_map mapped_image_;
+	std::vector<char> owned_image_;
+
+	const dictionary_file_header* header_ = nullptr;
+	const uint32_t* word_offsets_ = nullptr;
+	const uint32_t* displacements_ = nullptr;
+	const uint32_t* slots_ = nullptr;
+	const wchar_t* pool_ = nullptr;
+
+	/**
+	 * Sets up the section pointers, the mapping stays empty if the image is not valid
+	 */
+	void attach(const char* image, const size_t size)
+	{
+		if (!image || size < sizeof(dictionary_file_header))
+			return;
+
+		const auto header = reinterpret_cast<const dictionary_file_header*>(image);
+
+		if (memcmp(header->magic, dictionary_file_magic, sizeof dictionary_file_magic) != 0 ||
+			header->char_size != sizeof(wchar_t) || header->slot_count == 0)
+			return;
+
+		if (header->bucket_count == 0 && (header->slot_count & (header->slot_count - 1)) != 0)
+			return;
+
+		const size_t offsets_size = (static_cast<size_t>(header->word_count) + 2) * sizeof(uint32_t);
+		const size_t displacements_size = static_cast<size_t>(header->bucket_count) * sizeof(uint32_t);
+		const size_t slots_size = static_cast<size_t>(header->slot_count) * sizeof(uint32_t);
+		const size_t pool_size = static_cast<size_t>(header->pool_length) * sizeof(wchar_t);
+
+		if (sizeof(dictionary_file_header) + offsets_size + displacements_size + slots_size + pool_size > size)
+			return;
+
+		auto section = image + sizeof(dictionary_file_header);
+
+		word_offsets_ = reinterpret_cast<const uint32_t*>(section);
+		section += offsets_size;
+		displacements_ = reinterpret_cast<const uint32_t*>(section);
+		section += displacements_size;
+		slots_ = reinterpret_cast<const uint32_t*>(section);
+		section += slots_size;
+		pool_ = reinterpret_cast<const wchar_t*>(section);
+
+		header_ = header;
+	}
 
 public:
 	word_mapping() = default;
 
-	explicit word_mapping(mutable_word_mapping&& wm) : word_to_int_map_(wm.word_to_int_map),
-	                                                   int_to_word_map_(wm.int_to_word_map)
+	explicit word_mapping(mem_map&& mm) : mapped_image_(std::move(mm))
 	{
+		attach(mapped_image_.data(), mapped_image_.size());
 	}
 
+	explicit word_mapping(std::vector<char>&& image) : owned_image_(std::move(image))
+	{
+		attach(owned_image_.data(), owned_image_.size());
+	}
 
-	int word_to_int(std::wstring& word) const
+	/**
+	 * Does not allocate - any contiguous sequence of wchar_t can be looked up
+	 *
+	 * @return The int code of the word, 0 if the word is not in the dictionary
+	 */
+	int word_to_int(const std::wstring_view word) const
 	{
-		const auto return_val = word_to_int_map_.find(word);
+		if (!header_ || word.empty())
+			return 0;
+
+		const auto hash = hash_word(word, header_->seed);
+
+		if (header_->bucket_count == 0)
+		{
+			const auto mask = header_->slot_count - 1;
+
+			for (auto slot = hash & mask;; slot = (slot + 1) & mask)
+			{
+				const auto number = slots_[slot];
 
-		if (return_val != word_to_int_map_.end())
-			return return_val->second;
+				if (number == 0)
+					return 0;
+				if (int_to_word(number) == word)
+					return number;
+			}
+		}
+
+		const auto ph = perfect_hash(hash, header_->bucket_count, header_->slot_count);
+		const auto number = slots_[ph.slot(displacements_[ph.bucket], header_->slot_count)];
+
+		if (number != 0 && int_to_word(number) == word)
+			return number;
 
 		return 0;
 	}
 
-	const std::wstring* int_to_word(const int number) const
+	/**
+	 * @return View of the word in the string pool, an empty view for unknown int codes
+	 */
+	std::wstring_view int_to_word(const int number) const
+	{
+		if (!header_ || number <= 0 || static_cast<uint32_t>(number) > header_->word_count)
+			return {};
+
+		return {pool_ + word_offsets_[number], word_offsets_[number + 1] - word_offsets_[number]};
+	}
+
+	size_t size() const
+	{
+		return header_ ? header_->word_count : 0;
+	}
+
+	/**
+	 * @return Bytes taken by the dictionary image
+	 */
+	size_t memory_size() const
+	{
+		if (!header_)
+			return 0;
+
+		return mapped_image_.data() ? mapped_image_.size() : owned_image_.size();
+	}
+
+	bool empty() const
 	{
-		return &int_to_word_map_.find(number)->second;
+		return header_ == nullptr;
 	}
 };
 
 /**
- * An immutable hashtable for words in int format and line offset values\n
+ * A contiguous range of model records that belong to a single middle word, both values are in records (16B)
+ */
+struct model_block
+{
+	int32_t offset = 0;
+	int32_t length = 0;
+};
+
+static_assert(sizeof(model_block) == 2 * 4, "The binary offset file stores two INT32 values per word");
+
+/**
+ * Header of the binary offset file, followed by 'entry_count' of model_block values indexed by the int code of a word
+ */
+struct offset_file_header
+{
+	char magic[8];
+	uint32_t entry_count;
+	uint32_t reserved;
+};
+
+static const char offset_file_magic[8] = {'D', 'I', 'A', 'C', 'O', 'F', 'F', '1'};
+
+/**
+ * A mutable dense array of model blocks indexed by the int code of a word\n
+ * Word codes are dense (1..N), hence the array has virtually no holes
  */
 class mutable_offset_table
 {
 public:
-	std::unordered_map<int, int> compressed_model;
+	std::vector<model_block> compressed_model;
 
-	void insert(int key, int count)
+	void insert(const int key, const int offset, const int length)
 	{
-		compressed_model.insert(std::pair<int, int>(key, count));
+		if (key <= 0)
+			return;
+
+		if (static_cast<size_t>(key) >= compressed_model.size())
+			compressed_model.resize(key + 1);
+
+		compressed_model[key] = model_block{offset, length};
 	}
 
-	int get_value(const int key)
+	model_block get_block(const int key) const
 	{
+		if (key <= 0 || static_cast<size_t>(key) >= compressed_model.size())
+			return {};
+
 		return compressed_model[key];
 	}
 
@@ -101,27 +276,63 @@ public:
 };
 
 /**
- * An immutable hashtable for words in int format and line offset values\n
- * Instances are created by making a copy of an existing mutable_model object
+ * An immutable dense array of model blocks indexed by the int code of a word\n
+ * Instances either take over the array of a mutable_offset_table or map a binary offset file directly
  */
 class offset_table
 {
-	const std::unordered_map<int, int> compressed_model_;
+	std::vector<model_block> owned_blocks_;
+	mem_map mapped_blocks_;
+	const model_block* blocks_ = nullptr;
+	size_t size_ = 0;
 
 public:
 	offset_table() = default;
 
-	explicit offset_table(mutable_offset_table&& m) : compressed_model_(m.compressed_model)
+	explicit offset_table(mutable_offset_table&& m) : owned_blocks_(std::move(m.compressed_model))
+	{
+		blocks_ = owned_blocks_.data();
+		size_ = owned_blocks_.size();
+	}
+
+	/**
+	 * Uses a mapped binary offset file, the table stays empty if the file is not valid
+	 */
+	explicit offset_table(mem_map&& mm) : mapped_blocks_(std::move(mm))
 	{
+		const auto header = reinterpret_cast<const offset_file_header*>(
+			mapped_blocks_.block(0, sizeof(offset_file_header)));
+
+		if (!header || memcmp(header->magic, offset_file_magic, sizeof offset_file_magic) != 0)
+			return;
+
+		const auto blocks = mapped_blocks_.block(sizeof(offset_file_header), header->entry_count * sizeof(model_block));
+
+		if (!blocks)
+			return;
+
+		blocks_ = reinterpret_cast<const model_block*>(blocks);
+		size_ = header->entry_count;
 	}
 
-	int get_value(const int key) const
+	/**
+	 * @return The model block of a word, an empty block if the word has no records in the model
+	 */
+	model_block get_block(const int key) const
 	{
-		return compressed_model_.find(key)->second;
+		if (key <= 0 || static_cast<size_t>(key) >= size_)
+			return {};
+
+		return blocks_[key];
 	}
 
 	size_t size() const
 	{
-		return compressed_model_.size();
+		return size_;
+	}
+
+	bool empty() const
+	{
+		return size_ == 0;
 	}
 };
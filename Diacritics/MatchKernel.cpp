@@ -0,0 +1,455 @@
+#include "MatchKernel.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIAC_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define DIAC_X86 0
+#endif
+
+#if DIAC_X86 && !defined(_MSC_VER)
+#define DIAC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DIAC_TARGET_AVX2
+#endif
+
+namespace
+{
+	/**
+	 * Rows of model records viewed by a block_view - the third word and the count directly follow the first word
+	 */
+	bool is_record_layout(const block_view& block)
+	{
+		return block.stride() == 4 && block.third_data() == block.first_data() + 1 &&
+			block.count_data() == block.first_data() + 2;
+	}
+
+	int32_t sum_scalar(const block_view& block)
+	{
+		uint32_t sum = 0;
+
+		for (size_t i = 0; i < block.size(); i++)
+			sum += static_cast<uint32_t>(block.count(i));
+
+		return static_cast<int32_t>(sum);
+	}
+
+	/**
+	 * Starting at 'i', appends the counts of the remaining records one at a time
+	 */
+	template <int Arity>
+	void match_tail(const block_view& block, size_t i, const int32_t first_w, const int32_t third_w,
+	                std::vector<int32_t>& counts)
+	{
+		for (; i < block.size(); i++)
+			if (block.first(i) == first_w && (Arity == 2 || block.third(i) == third_w))
+				counts.push_back(block.count(i));
+	}
+
+	template <int Arity>
+	void match_scalar(const block_view& block, const int32_t first_w, const int32_t third_w,
+	                  std::vector<int32_t>& counts)
+	{
+		match_tail<Arity>(block, 0, first_w, third_w, counts);
+	}
+
+#if DIAC_X86
+
+	unsigned lowest_bit(const unsigned mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+	}
+
+	/**
+	 * Appends counts of the records marked in 'mask' relative to the 'base' record, every record
+	 * occupies 1 << 'shift' bits of the mask
+	 */
+	void append_hits(const block_view& block, const size_t base, unsigned mask, const unsigned shift,
+	                 std::vector<int32_t>& counts)
+	{
+		while (mask)
+		{
+			counts.push_back(block.count(base + (lowest_bit(mask) >> shift)));
+			mask &= mask - 1;
+		}
+	}
+
+	int32_t sum_sse2(const block_view& block)
+	{
+		const auto size = block.size();
+		auto accumulator = _mm_setzero_si128();
+		size_t i = 0;
+		uint32_t sum = 0;
+
+		// A single record per register does not pay off, rows are left to the scalar loop below
+		if (block.stride() == 1)
+		{
+			for (; i + 4 <= size; i += 4)
+				accumulator = _mm_add_epi32(
+					accumulator, _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.count_data() + i)));
+		}
+
+		alignas(16) uint32_t lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+
+		for (const auto lane : lanes)
+			sum += lane;
+
+		for (; i < size; i++)
+			sum += static_cast<uint32_t>(block.count(i));
+
+		return static_cast<int32_t>(sum);
+	}
+
+	template <int Arity>
+	void match_sse2(const block_view& block, const int32_t first_w, const int32_t third_w,
+	                std::vector<int32_t>& counts)
+	{
+		const auto size = block.size();
+		size_t i = 0;
+
+		if (block.stride() == 1)
+		{
+			const auto first_key = _mm_set1_epi32(first_w);
+			const auto third_key = _mm_set1_epi32(third_w);
+
+			for (; i + 4 <= size; i += 4)
+			{
+				auto hit = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block.first_data() + i)),
+				                           first_key);
+
+				if (Arity == 3)
+					hit = _mm_and_si128(hit, _mm_cmpeq_epi32(
+						                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.third_data() + i)),
+						                    third_key));
+
+				append_hits(block, i, static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(hit))), 0, counts);
+			}
+		}
+
+		match_tail<Arity>(block, i, first_w, third_w, counts);
+	}
+
+	DIAC_TARGET_AVX2 int32_t sum_avx2(const block_view& block)
+	{
+		const auto size = block.size();
+		auto accumulator = _mm256_setzero_si256();
+		size_t i = 0;
+		uint32_t sum = 0;
+
+		if (block.stride() == 1)
+		{
+			for (; i + 8 <= size; i += 8)
+				accumulator = _mm256_add_epi32(
+					accumulator, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.count_data() + i)));
+		}
+		else if (is_record_layout(block))
+		{
+			// Two records per register, the load starts at the first word so that it never reaches past the block
+			for (; i + 2 < size; i += 2)
+				accumulator = _mm256_add_epi32(
+					accumulator, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.first_data() + 4 * i)));
+
+			accumulator = _mm256_and_si256(accumulator, _mm256_setr_epi32(0, 0, -1, 0, 0, 0, -1, 0));
+		}
+
+		alignas(32) uint32_t lanes[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), accumulator);
+
+		for (const auto lane : lanes)
+			sum += lane;
+
+		for (; i < size; i++)
+			sum += static_cast<uint32_t>(block.count(i));
+
+		return static_cast<int32_t>(sum);
+	}
+
+	template <int Arity>
+	DIAC_TARGET_AVX2 void match_avx2(const block_view& block, const int32_t first_w, const int32_t third_w,
+	                                 std::vector<int32_t>& counts)
+	{
+		const auto size = block.size();
+		size_t i = 0;
+
+		if (block.stride() == 1)
+		{
+			const auto first_key = _mm256_set1_epi32(first_w);
+			const auto third_key = _mm256_set1_epi32(third_w);
+
+			for (; i + 8 <= size; i += 8)
+			{
+				auto hit = _mm256_cmpeq_epi32(
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.first_data() + i)), first_key);
+
+				if (Arity == 3)
+					hit = _mm256_and_si256(hit, _mm256_cmpeq_epi32(
+						                       _mm256_loadu_si256(
+							                       reinterpret_cast<const __m256i*>(block.third_data() + i)),
+						                       third_key));
+
+				append_hits(block, i, static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(hit))), 0, counts);
+			}
+		}
+		else if (is_record_layout(block))
+		{
+			// Four records per iteration, every record yields four lanes - the first word, the third word,
+			// the count and the middle word of the next record
+			const auto key = _mm256_setr_epi32(first_w, third_w, 0, 0, first_w, third_w, 0, 0);
+
+			for (; i + 4 < size; i += 4)
+			{
+				const auto low = _mm256_cmpeq_epi32(
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.first_data() + 4 * i)), key);
+				const auto high = _mm256_cmpeq_epi32(
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.first_data() + 4 * i + 8)), key);
+
+				auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(low))) |
+					static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(high))) << 8;
+
+				if (Arity == 3)
+					mask &= mask >> 1;
+
+				append_hits(block, i, mask & 0x1111u, 2, counts);
+			}
+		}
+
+		match_tail<Arity>(block, i, first_w, third_w, counts);
+	}
+
+#endif
+
+	/**
+	 * @return Index of the first record in [begin, end) whose first word is not less than 'first_w'
+	 * (greater than 'first_w' for the upper bound)
+	 */
+	size_t first_bound(const block_view& block, size_t begin, size_t end, const int32_t first_w, const bool upper)
+	{
+		while (begin < end)
+		{
+			const auto middle = begin + (end - begin) / 2;
+			const auto value = block.first(middle);
+
+			if (value < first_w || (upper && value == first_w))
+				begin = middle + 1;
+			else
+				end = middle;
+		}
+
+		return begin;
+	}
+
+	/**
+	 * See first_bound, the range has to share a single first word
+	 */
+	size_t third_bound(const block_view& block, size_t begin, size_t end, const int32_t third_w, const bool upper)
+	{
+		while (begin < end)
+		{
+			const auto middle = begin + (end - begin) / 2;
+			const auto value = block.third(middle);
+
+			if (value < third_w || (upper && value == third_w))
+				begin = middle + 1;
+			else
+				end = middle;
+		}
+
+		return begin;
+	}
+
+	/**
+	 * The fence pointers confine the bound of 'first_w' to a single interval, so the search over the first
+	 * column touches only a couple of cache lines
+	 */
+	size_t fenced_first_bound(const block_view& block, const int32_t first_w, const bool upper)
+	{
+		if (block.fence_count() == 0)
+			return first_bound(block, 0, block.size(), first_w, upper);
+
+		const auto fences = block.fences();
+		const auto fence_end = fences + block.fence_count();
+		const auto fence = static_cast<size_t>((upper
+			                                        ? std::upper_bound(fences, fence_end, first_w)
+			                                        : std::lower_bound(fences, fence_end, first_w)) - fences);
+
+		const auto begin = fence ? (fence - 1) * fence_interval : 0;
+		const auto end = std::min(fence * fence_interval, block.size());
+
+		return first_bound(block, begin, end, first_w, upper);
+	}
+}
+
+simd_level detect_simd_level()
+{
+#if DIAC_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+
+	if (info[0] >= 7)
+	{
+		__cpuid(info, 1);
+		const auto os_saves_avx = (info[2] & 1 << 27) && (info[2] & 1 << 28) && (_xgetbv(0) & 0x6) == 0x6;
+
+		__cpuidex(info, 7, 0);
+
+		if (os_saves_avx && info[1] & 1 << 5)
+			return simd_level::avx2;
+	}
+
+	return simd_level::sse2;
+#else
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return simd_level::avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return simd_level::sse2;
+#endif
+#endif
+
+	return simd_level::scalar;
+}
+
+kernel_set get_kernels(const simd_level level)
+{
+#if DIAC_X86
+	if (level == simd_level::avx2)
+		return {simd_level::avx2, "avx2", sum_avx2, match_avx2<2>, match_avx2<3>};
+	if (level == simd_level::sse2)
+		return {simd_level::sse2, "sse2", sum_sse2, match_sse2<2>, match_sse2<3>};
+#endif
+
+	return {simd_level::scalar, "scalar", sum_scalar, match_scalar<2>, match_scalar<3>};
+}
+
+const kernel_set& active_kernels()
+{
+	static const auto kernels = get_kernels(detect_simd_level());
+
+	return kernels;
+}
+
+block_view narrow_block(const block_view& block, const int32_t first_w)
+{
+	if (!block.sorted())
+		return block;
+
+	return block.slice(fenced_first_bound(block, first_w, false), fenced_first_bound(block, first_w, true));
+}
+
+block_view narrow_block(const block_view& block, const int32_t first_w, const int32_t third_w)
+{
+	if (!block.sorted())
+		return block;
+
+	const auto context = narrow_block(block, first_w);
+
+	return context.slice(third_bound(context, 0, context.size(), third_w, false),
+	                     third_bound(context, 0, context.size(), third_w, true));
+}
+
+void collect_evidence(const kernel_set& kernels, const block_view& block, const std::vector<int32_t>& left,
+                      const std::vector<int32_t>& right, const unsigned flags, block_evidence& evidence)
+{
+	const auto want_left = (flags & evidence_left) != 0;
+	const auto want_pairs = (flags & evidence_pairs) != 0;
+
+	if (flags & evidence_total)
+		evidence.total = kernels.unigram(block);
+
+	if ((!want_left && !want_pairs) || left.empty())
+		return;
+
+	if (block.sorted())
+	{
+		for (uint32_t i = 0; i < left.size(); i++)
+		{
+			const auto context = narrow_block(block, left[i]);
+
+			if (want_left)
+				for (size_t k = 0; k < context.size(); k++)
+					evidence.left_hits.emplace_back(i, context.count(k));
+
+			if (want_pairs)
+				for (uint32_t j = 0; j < right.size(); j++)
+				{
+					const auto pair = narrow_block(context, left[i], right[j]);
+
+					for (size_t k = 0; k < pair.size(); k++)
+						evidence.pair_hits.emplace_back(i, j, pair.count(k));
+				}
+		}
+
+		return;
+	}
+
+	thread_local std::vector<int32_t> counts;
+
+	// A single context of a single arity is left to the kernels
+	if (left.size() == 1 && want_left != want_pairs && (want_left || right.size() == 1))
+	{
+		counts.clear();
+
+		if (want_left)
+		{
+			kernels.bigram(block, left[0], 0, counts);
+
+			for (const auto count : counts)
+				evidence.left_hits.emplace_back(0, count);
+		}
+		else
+		{
+			kernels.trigram(block, left[0], right[0], counts);
+
+			for (const auto count : counts)
+				evidence.pair_hits.emplace_back(0, 0, count);
+		}
+
+		return;
+	}
+
+	const auto left_begin = evidence.left_hits.size();
+	const auto pair_begin = evidence.pair_hits.size();
+
+	for (size_t k = 0; k < block.size(); k++)
+	{
+		const auto first = std::find(left.begin(), left.end(), block.first(k));
+
+		if (first == left.end())
+			continue;
+
+		const auto i = static_cast<uint32_t>(first - left.begin());
+
+		if (want_left)
+			evidence.left_hits.emplace_back(i, block.count(k));
+
+		if (want_pairs)
+		{
+			const auto third = std::find(right.begin(), right.end(), block.third(k));
+
+			if (third != right.end())
+				evidence.pair_hits.emplace_back(i, static_cast<uint32_t>(third - right.begin()), block.count(k));
+		}
+	}
+
+	// The scan yields the hits in the order of the records, the requests come first
+	std::stable_sort(evidence.left_hits.begin() + left_begin, evidence.left_hits.end(),
+	                 [](const auto& a, const auto& b) { return a.first < b.first; });
+	std::stable_sort(evidence.pair_hits.begin() + pair_begin, evidence.pair_hits.end(), [](const auto& a, const auto& b)
+	{
+		return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b));
+	});
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "TrigramModel.h"
+
+/**
+ * Instruction sets the context matching kernels are compiled for
+ */
+enum class simd_level
+{
+	scalar,
+	sse2,
+	avx2
+};
+
+/**
+ * Sums the counts of all records of a block - the unigram lookup
+ */
+using sum_kernel = int32_t (*)(const block_view& block);
+
+/**
+ * Appends the counts of records whose context matches 'first_w' (and 'third_w' for trigrams) to 'counts',
+ * in the order of the records in the block
+ */
+using match_kernel = void (*)(const block_view& block, int32_t first_w, int32_t third_w, std::vector<int32_t>& counts);
+
+/**
+ * One implementation of every arity, all of them compiled for the same instruction set
+ */
+struct kernel_set
+{
+	simd_level level;
+	const char* name;
+	sum_kernel unigram;
+	match_kernel bigram;
+	match_kernel trigram;
+};
+
+/**
+ * @return The widest instruction set supported by both the build and the processor
+ */
+simd_level detect_simd_level();
+
+/**
+ * @return Kernels for the requested instruction set, the scalar ones if the set is not available in this build
+ */
+kernel_set get_kernels(simd_level level);
+
+/**
+ * @return Kernels for the detected instruction set, the detection runs only once
+ */
+const kernel_set& active_kernels();
+
+/**
+ * Requested evidence of collect_evidence
+ */
+constexpr unsigned evidence_total = 1;
+constexpr unsigned evidence_left = 2;
+constexpr unsigned evidence_pairs = 4;
+
+/**
+ * Evidence found in the block of one middle word - the sum of its counts, the counts of the records matching
+ * each requested preceding word and each requested (preceding, following) pair\n
+ * Hits refer to the requested words by their index and are ordered by the request first, by the records second
+ */
+struct block_evidence
+{
+	int32_t total = 0;
+	std::vector<std::pair<uint32_t, int32_t>> left_hits;
+	std::vector<std::tuple<uint32_t, uint32_t, int32_t>> pair_hits;
+
+	void clear()
+	{
+		total = 0;
+		left_hits.clear();
+		pair_hits.clear();
+	}
+};
+
+/**
+ * Collects the requested evidence for all preceding words in 'left' and following words in 'right' from a single
+ * read of the block - sorted blocks are narrowed once per preceding word, others are scanned in one pass
+ *
+ * @param flags Combination of evidence_total, evidence_left and evidence_pairs
+ */
+void collect_evidence(const kernel_set& kernels, const block_view& block, const std::vector<int32_t>& left,
+                      const std::vector<int32_t>& right, unsigned flags, block_evidence& evidence);
+
+/**
+ * @return Records of a sorted block whose first word is 'first_w', found by a binary search over the fence
+ * pointers and the first column; unsorted blocks are returned as they are
+ */
+block_view narrow_block(const block_view& block, int32_t first_w);
+
+/**
+ * @return Records of a sorted block with the context ('first_w', 'third_w'); unsorted blocks are returned as they are
+ */
+block_view narrow_block(const block_view& block, int32_t first_w, int32_t third_w);
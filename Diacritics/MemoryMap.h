@@ -1,167 +1,207 @@
 #pragma once
-#include <memory>
-#include <cassert>
+#include <cstring>
 #include <string>
-#include <filesystem>
-#include <mutex>
-#include <shared_mutex>
-#include <atomic>
+#include <utility>
 
-#include "ErrorHandler.h"
-#include <fstream>
-#include <unordered_map>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-#define PAGE_SIZE (4096 * 1024)
-
-inline bool is_power_of_two(const size_t n)
-{
-	return n != 0 && (n & n - 1) == 0;
-}
+#include "Instrumentation.h"
 
 /**
- * An object that stores N bytes of data from a file, preferably 4096 KB, and an offset of the page in said file in bytes
+ * A read-only view of an entire file mapped into the address space by the operating system.\n
+ * The pages are backed by the system file cache, hence they are shared by all threads of the process
+ * as well as by every other process that maps the same file.
  */
-template <size_t N>
-class page
+class mem_map
 {
-	const size_t page_size_ = N;
-	const size_t offset_from_beg_;
-	std::shared_ptr<char[]> contains_;
+	const char* data_ = nullptr;
+	size_t file_size_ = 0;
+
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = nullptr;
+#endif
+
+	void unmap()
+	{
+#ifdef _WIN32
+		if (data_)
+			UnmapViewOfFile(data_);
+		if (mapping_)
+			CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle(file_);
+
+		mapping_ = nullptr;
+		file_ = INVALID_HANDLE_VALUE;
+#else
+		if (data_)
+			munmap(const_cast<char*>(data_), file_size_);
+#endif
+
+		data_ = nullptr;
+		file_size_ = 0;
+	}
 
 public:
-	page(const size_t offset, const std::string& file) : offset_from_beg_(offset)
+	mem_map() = default;
+
+	/**
+	 * Maps the whole file, the object evaluates to false if the file could not be mapped
+	 */
+	explicit mem_map(const std::string& file)
 	{
-		PROFILE_FUNCTION();
-		
-		assert(is_power_of_two(page_size_) == true);
-		contains_ = std::shared_ptr<char[]>(new char[page_size_]);
+#ifdef _WIN32
+		file_ = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+
+		if (file_ == INVALID_HANDLE_VALUE)
+			return;
 
-		std::ifstream ifs(file, std::ios::in | std::ios::binary);
+		LARGE_INTEGER size;
 
-		if(ifs)
+		if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
 		{
-			ifs.seekg(offset_from_beg_, std::ios::_Seekbeg);
-			ifs.read(contains_.get(), page_size_);
+			unmap();
+			return;
 		}
+
+		mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (!mapping_)
+		{
+			unmap();
+			return;
+		}
+
+		data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+
+		if (!data_)
+		{
+			unmap();
+			return;
+		}
+
+		file_size_ = static_cast<size_t>(size.QuadPart);
+#else
+		const auto fd = open(file.c_str(), O_RDONLY);
+
+		if (fd < 0)
+			return;
+
+		struct stat st {};
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			const auto address = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+			if (address != MAP_FAILED)
+			{
+				data_ = static_cast<const char*>(address);
+				file_size_ = static_cast<size_t>(st.st_size);
+
+				madvise(address, file_size_, MADV_RANDOM);
+			}
+		}
+
+		close(fd);
+#endif
 	}
 
-	/**
-	 * Returns a pointer to the segment of memory that stores all the data
-	 */
-	[[nodiscard]] std::shared_ptr<char[]> get_data_handle() const
+	mem_map(const mem_map&) = delete;
+	mem_map& operator=(const mem_map&) = delete;
+
+	mem_map(mem_map&& mm) noexcept
 	{
-		return contains_;
+		*this = std::move(mm);
 	}
 
-	[[nodiscard]] size_t size() const
+	mem_map& operator=(mem_map&& mm) noexcept
 	{
-		return page_size_;
+		if (this != &mm)
+		{
+			unmap();
+
+			std::swap(data_, mm.data_);
+			std::swap(file_size_, mm.file_size_);
+#ifdef _WIN32
+			std::swap(file_, mm.file_);
+			std::swap(mapping_, mm.mapping_);
+#endif
+		}
+
+		return *this;
 	}
 
-	[[nodiscard]] size_t get_offset() const
+	~mem_map()
 	{
-		return offset_from_beg_;
+		unmap();
 	}
-};
-
-/**
- * A collection of pages that represents a single file.\n
- * Pages are allocated continually as different segments of the file are read.
- */
-class mem_map
-{
-	const size_t file_size_;
-	const std::string file_name_;
-	const static size_t page_size = PAGE_SIZE;
-	std::unordered_map<size_t, page<page_size>> page_map_;
-	mutable std::shared_mutex page_mutex_;
 
-public:
-	explicit mem_map(const std::string& file) : file_size_(std::filesystem::file_size(file)), file_name_(file)
+	explicit operator bool() const
 	{
-		std::wcout << L"The memory caching option has been used. Note that the supporting files will be slowly loaded into the system's memory.\n"
-			<< L"This option might perform much worse than the standard configuration. This is especially true for systems with fast storage.\n";
+		return data_ != nullptr;
 	}
 
 	/**
-	 * Supporting and optional function that loads the entire file at once, essentially defeating the purpose of this class.\n
-	 * Yields notable performance improvements compared to the normal version.
+	 * Touches every page of the mapping so that subsequent lookups do not cause page faults.\n
+	 * Replaces the former 'load all pages' behaviour - the data is not copied, it only gets pulled into the file cache.
 	 */
-	void load_all_pages()
+	void prefault() const
 	{
-		// lock mutex
-		std::unique_lock write_lock(page_mutex_);
+		PROFILE_FUNCTION();
 
-		for (auto i = 0; i < file_size_; i += page_size)
-		{
-			// create UNIQUE page
-			auto page_ = page<page_size>(i, file_name_);
-			// touch the page_map_
-			page_map_.emplace(i, std::move(page_));
-		}
-		// unlock mutex
+		volatile char sink = 0;
+
+		for (size_t i = 0; i < file_size_; i += 4096)
+			sink += data_[i];
+
+		(void)sink;
 	}
 
 	/**
-	 * Reads 'count' of bytes from 'offset' position in file to the 'buffer' storage.
+	 * Copies 'count' of bytes from 'offset' position in file to the 'buffer' storage.\n
+	 * Bytes past the end of the file are zeroed.
 	 */
-	void read(char* buffer, const size_t count, const size_t offset)
+	void read(char* buffer, const size_t count, const size_t offset) const
 	{
-		PROFILE_FUNCTION();
-		
-		size_t nearest_offset = (offset / page_size) * page_size;
-
-		// lock mutex for reading
-		page_mutex_.lock_shared();
-		auto it = page_map_.find(nearest_offset);
-
-		// unlock mutex for reading
-		page_mutex_.unlock_shared();
+		const auto available = offset < file_size_ ? file_size_ - offset : 0;
+		const auto copied = count < available ? count : available;
 
-		if (it == page_map_.end())
-		{
-			// create a page - each page could have a dedicated mutex to prevent loading the same page multiple times
-			auto page_ = page<page_size>(nearest_offset, file_name_);
-
-			// lock mutex for writing
-			std::unique_lock write_lock(page_mutex_);
-			it = page_map_.emplace(nearest_offset, std::move(page_)).first;
+		if (copied)
+			memcpy(buffer, data_ + offset, copied);
+		if (copied < count)
+			memset(buffer + copied, 0, count - copied);
+	}
 
-			// unlock mutex for writing
-		}
+	/**
+	 * @return Pointer to 'length' bytes at 'offset' inside the mapping, nullptr if the range exceeds the file
+	 */
+	[[nodiscard]] const char* block(const size_t offset, const size_t length) const
+	{
+		if (!data_ || offset > file_size_ || length > file_size_ - offset)
+			return nullptr;
 
-		for (auto i = 0; i < count; i++)
-		{
-			if (offset - nearest_offset + i >= page_size)
-			{
-				nearest_offset += page_size;
-
-				// lock mutex for reading
-				page_mutex_.lock_shared();
-				it = page_map_.find(nearest_offset);
-				
-				// unlock mutex for reading
-				page_mutex_.unlock_shared();
-
-				if (it == page_map_.end())
-				{
-					// create a page - each page could have a dedicated mutex to prevent loading the same page multiple times
-					auto page_ = page<page_size>(nearest_offset, file_name_);
-
-					// lock mutex for writing
-					std::unique_lock write_lock(page_mutex_);
-					it = page_map_.emplace(nearest_offset, std::move(page_)).first;
-
-					// unlock mutex for writing
-				}
-			}
+		return data_ + offset;
+	}
 
-			buffer[i] = it->second.get_data_handle()[offset - nearest_offset + i];
-		}
+	/**
+	 * @return Pointer to the first byte of the mapped file
+	 */
+	[[nodiscard]] const char* data() const
+	{
+		return data_;
 	}
 
-	size_t size() const
+	[[nodiscard]] size_t size() const
 	{
 		return file_size_;
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,208 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Fixed set of worker threads with a task queue each - a worker takes the newest task of its own queue first
+ * and steals the oldest task of another queue when its own one is empty\n
+ * Tasks submitted by a worker go to its own queue, the others are dealt to the queues in turn
+ */
+class work_stealing_pool
+{
+	struct task_queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<task_queue>> queues_;
+	std::vector<std::thread> threads_;
+
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	std::atomic<size_t> queued_{0};
+	std::atomic<size_t> next_queue_{0};
+	bool stopping_ = false;
+
+	/**
+	 * The pool the current thread works for and the index of its queue
+	 */
+	static const work_stealing_pool*& current_pool()
+	{
+		thread_local const work_stealing_pool* pool = nullptr;
+		return pool;
+	}
+
+	static size_t& current_queue()
+	{
+		thread_local size_t index = 0;
+		return index;
+	}
+
+	static void pin_to_core(const size_t core)
+	{
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core % (sizeof(DWORD_PTR) * 8));
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core % CPU_SETSIZE, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+#endif
+	}
+
+	bool pop(const size_t index, std::function<void()>& task)
+	{
+		auto& own = *queues_[index];
+
+		{
+			std::lock_guard<std::mutex> lock(own.mutex);
+
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < queues_.size(); i++)
+		{
+			auto& victim = *queues_[(index + i) % queues_.size()];
+
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void work(const size_t index, const bool pin)
+	{
+		if (pin)
+			pin_to_core(index);
+
+		current_pool() = this;
+		current_queue() = index;
+
+		std::function<void()> task;
+
+		for (;;)
+		{
+			if (pop(index, task))
+			{
+				queued_--;
+				task();
+				task = nullptr;
+
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+
+			wake_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+
+			if (stopping_ && queued_ == 0)
+				return;
+		}
+	}
+
+public:
+	/**
+	 * @param thread_count Number of workers, 0 for one worker per hardware thread
+	 * @param pin Binds every worker to its own core
+	 */
+	explicit work_stealing_pool(size_t thread_count = 0, const bool pin = false)
+	{
+		if (thread_count == 0)
+			thread_count = std::thread::hardware_concurrency();
+		if (thread_count == 0)
+			thread_count = 1;
+
+		for (size_t i = 0; i < thread_count; i++)
+			queues_.push_back(std::make_unique<task_queue>());
+
+		for (size_t i = 0; i < thread_count; i++)
+			threads_.emplace_back(&work_stealing_pool::work, this, i, pin);
+	}
+
+	work_stealing_pool(const work_stealing_pool&) = delete;
+	work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+	/**
+	 * The queued tasks are finished first, a worker that ends the program is left running
+	 */
+	~work_stealing_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			stopping_ = true;
+		}
+
+		wake_.notify_all();
+
+		for (auto& thread : threads_)
+		{
+			if (thread.get_id() == std::this_thread::get_id())
+				thread.detach();
+			else
+				thread.join();
+		}
+	}
+
+	/**
+	 * Queues the task
+	 *
+	 * @return Future of the result of the task, it does not wait for the task when destroyed
+	 */
+	template <typename Task>
+	auto submit(Task&& task) -> std::future<decltype(task())>
+	{
+		auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<Task>(task));
+		auto future = packaged->get_future();
+
+		const auto index = current_pool() == this ? current_queue() : next_queue_++ % queues_.size();
+
+		// Counted before it is queued, so that the count never drops below the number of queued tasks
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			queued_++;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+			queues_[index]->tasks.emplace_back([packaged] { (*packaged)(); });
+		}
+
+		wake_.notify_one();
+
+		return future;
+	}
+
+	size_t size() const
+	{
+		return threads_.size();
+	}
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include <cwctype>
+#include <istream>
+#include <string>
+
+#include "WideCharUtilities.h"
+
+/**
+ * Word of the text as the model sees it - 'raw' keeps the casing and the formatting characters, 'word' is
+ * the prepared form (lowercase, without quotes, commas, ...)
+ */
+struct text_word
+{
+	std::wstring raw;
+	std::wstring word;
+};
+
+/**
+ * Run of non-whitespace characters of the text with everything needed to write it back
+ */
+struct text_token
+{
+	// As written in the text, the reference for the formatting of the result
+	std::wstring text;
+	text_word word;
+
+	// Punctuation split off the end of the word, in the order separate_punctuation returns it
+	std::wstring punctuation;
+
+	// Whitespace that follows the token
+	std::wstring whitespace;
+};
+
+/**
+ * Splits the stream into tokens in a single pass over its buffer, every character is read once and the whitespace
+ * between the tokens is kept, so the text can be written back without reading it again
+ */
+class text_tokenizer
+{
+	using traits = std::wistream::traits_type;
+
+	std::wistream& stream_;
+	std::wstreambuf* buffer_;
+	std::wstring leading_whitespace_;
+
+	/**
+	 * Appends the characters of the buffer to 'text' as long as 'take' accepts them
+	 */
+	template <typename Take>
+	void read_while(std::wstring& text, Take&& take)
+	{
+		if (buffer_)
+		{
+			for (auto c = buffer_->sgetc(); !traits::eq_int_type(c, traits::eof()); c = buffer_->snextc())
+			{
+				if (!take(traits::to_char_type(c)))
+					return;
+
+				text.push_back(traits::to_char_type(c));
+			}
+		}
+
+		stream_.setstate(std::ios::eofbit);
+	}
+
+	static bool is_space(const wchar_t c)
+	{
+		return iswspace(c) != 0;
+	}
+
+public:
+	/**
+	 * Reads the whitespace at the beginning of the stream
+	 */
+	explicit text_tokenizer(std::wistream& stream) : stream_(stream), buffer_(stream.good() ? stream.rdbuf() : nullptr)
+	{
+		read_while(leading_whitespace_, is_space);
+	}
+
+	const std::wstring& leading_whitespace() const
+	{
+		return leading_whitespace_;
+	}
+
+	/**
+	 * Reads the next token and the whitespace after it
+	 *
+	 * @param split_punctuation Splits the trailing periods, commas, question and exclamation marks off the word
+	 * @return False at the end of the stream
+	 */
+	bool next(text_token& token, const bool split_punctuation)
+	{
+		token.text.clear();
+		token.punctuation.clear();
+		token.whitespace.clear();
+
+		read_while(token.text, [](const wchar_t c) { return !is_space(c); });
+
+		if (token.text.empty())
+			return false;
+
+		read_while(token.whitespace, is_space);
+
+		token.word.raw = token.text;
+
+		if (split_punctuation)
+			token.punctuation = separate_punctuation(token.word.raw);
+
+		token.word.word = token.word.raw;
+		prepare_word(token.word.word);
+
+		return true;
+	}
+};
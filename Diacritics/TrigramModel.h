@@ -0,0 +1,544 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BinaryReader.h"
+#include "LookupStructures.h"
+#include "MemoryMap.h"
+
+/**
+ * On-disk formats of the trigram model
+ */
+enum class model_format
+{
+	automatic,
+	raw,
+	varint,
+	columnar
+};
+
+/**
+ * @return The model format named on the command line ('auto', 'raw', 'varint' or 'columnar')
+ */
+inline model_format parse_model_format(const std::string& name)
+{
+	if (name == "auto")
+		return model_format::automatic;
+	if (name == "raw")
+		return model_format::raw;
+	if (name == "varint")
+		return model_format::varint;
+	if (name == "columnar")
+		return model_format::columnar;
+
+	throw_error(errors::invalid_option_error);
+
+	return model_format::automatic;
+}
+
+/**
+ * Header of the varint and columnar model files, followed by 'entry_count' of block_index_entry values
+ * indexed by the int code of the middle word and by the blocks themselves
+ */
+struct model_file_header
+{
+	char magic[8];
+	uint32_t entry_count;
+	uint32_t flags;
+};
+
+/**
+ * The records of every block are sorted by (first_w, third_w)
+ */
+constexpr uint32_t model_flag_sorted = 1;
+
+/**
+ * Sorted columnar blocks of at least this many records carry fence pointers - the first word of every
+ * 'fence_interval'-th record, stored after the count column
+ */
+constexpr size_t fence_threshold = 1024;
+constexpr size_t fence_interval = 64;
+
+/**
+ * Position of a single block in the varint or columnar model file
+ */
+struct block_index_entry
+{
+	uint64_t offset;
+	uint32_t length;
+	uint32_t size;
+};
+
+static_assert(sizeof(block_index_entry) == 16, "The varint model index stores 16B per word");
+
+static const char varint_model_magic[8] = {'D', 'I', 'A', 'C', 'V', 'B', '0', '1'};
+static const char columnar_model_magic[8] = {'D', 'I', 'A', 'C', 'C', 'O', 'L', '1'};
+
+/**
+ * Sorts the records of one block by (first_w, third_w), records with the same context keep their order
+ */
+inline void sort_block_records(std::vector<model_record>& records)
+{
+	std::stable_sort(records.begin(), records.end(), [](const model_record& a, const model_record& b)
+	{
+		return a.first_w != b.first_w ? a.first_w < b.first_w : a.third_w < b.third_w;
+	});
+}
+
+/**
+ * Column access to one block of the model - the first words, the third words and the counts are read
+ * through separate pointers, so a scan touches only the columns it compares\n
+ * Records stored as 16B rows are viewed with a stride of 4, the columnar model has a stride of 1
+ */
+class block_view
+{
+	const int32_t* first_ = nullptr;
+	const int32_t* third_ = nullptr;
+	const int32_t* count_ = nullptr;
+	size_t stride_ = 1;
+	size_t size_ = 0;
+	bool sorted_ = false;
+	const int32_t* fences_ = nullptr;
+	size_t fence_count_ = 0;
+
+public:
+	block_view() = default;
+
+	block_view(const int32_t* first, const int32_t* third, const int32_t* count, const size_t stride,
+	           const size_t size) : first_(first), third_(third), count_(count), stride_(stride), size_(size)
+	{
+	}
+
+	/**
+	 * A view over rows of model records
+	 */
+	explicit block_view(const record_span records) : stride_(sizeof(model_record) / sizeof(int32_t)),
+	                                                 size_(records.size())
+	{
+		if (records.empty())
+			return;
+
+		first_ = &records.begin()->first_w;
+		third_ = &records.begin()->third_w;
+		count_ = &records.begin()->count;
+	}
+
+	[[nodiscard]] int32_t first(const size_t i) const
+	{
+		return first_[i * stride_];
+	}
+
+	[[nodiscard]] int32_t third(const size_t i) const
+	{
+		return third_[i * stride_];
+	}
+
+	[[nodiscard]] int32_t count(const size_t i) const
+	{
+		return count_[i * stride_];
+	}
+
+	/**
+	 * Marks the block as sorted by (first_w, third_w), optionally with its fence pointers
+	 */
+	void set_sorted(const int32_t* fences = nullptr, const size_t fence_count = 0)
+	{
+		sorted_ = true;
+		fences_ = fences;
+		fence_count_ = fence_count;
+	}
+
+	/**
+	 * @return Records [begin, end) of the block, the fence pointers do not apply to the slice
+	 */
+	[[nodiscard]] block_view slice(const size_t begin, const size_t end) const
+	{
+		if (begin >= end)
+			return {};
+
+		auto view = block_view(first_ + begin * stride_, third_ + begin * stride_, count_ + begin * stride_,
+		                       stride_, end - begin);
+		view.sorted_ = sorted_;
+
+		return view;
+	}
+
+	[[nodiscard]] bool sorted() const
+	{
+		return sorted_;
+	}
+
+	[[nodiscard]] const int32_t* fences() const
+	{
+		return fences_;
+	}
+
+	[[nodiscard]] size_t fence_count() const
+	{
+		return fence_count_;
+	}
+
+	[[nodiscard]] const int32_t* first_data() const
+	{
+		return first_;
+	}
+
+	[[nodiscard]] const int32_t* third_data() const
+	{
+		return third_;
+	}
+
+	[[nodiscard]] const int32_t* count_data() const
+	{
+		return count_;
+	}
+
+	/**
+	 * @return Distance between two consecutive values of a column in int32 units
+	 */
+	[[nodiscard]] size_t stride() const
+	{
+		return stride_;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return size_;
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return size_ == 0;
+	}
+};
+
+/**
+ * Appends a LEB128 encoded value - 7 bits per byte, the highest bit marks a continuation
+ */
+inline void write_varint(std::vector<uint8_t>& destination, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		destination.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+
+	destination.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * Reads a LEB128 encoded value and moves the position past it, never reads past 'end'
+ */
+inline uint32_t read_varint(const uint8_t*& position, const uint8_t* end)
+{
+	uint32_t value = 0;
+
+	for (auto shift = 0; position < end && shift < 35; shift += 7)
+	{
+		const auto byte = *position++;
+		value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+		if (!(byte & 0x80))
+			break;
+	}
+
+	return value;
+}
+
+/**
+ * Encodes one block of records, the records have to be sorted by (first_w, third_w)\n
+ * first_w is stored as a delta from the previous record, third_w as a delta if first_w did not change
+ * and as an absolute value otherwise, the count is stored as is
+ */
+inline void encode_varint_block(const std::vector<model_record>& records, std::vector<uint8_t>& destination)
+{
+	int32_t previous_first = 0, previous_third = 0;
+
+	for (auto&& record : records)
+	{
+		const auto first_delta = static_cast<uint32_t>(record.first_w - previous_first);
+
+		write_varint(destination, first_delta);
+		write_varint(destination, static_cast<uint32_t>(first_delta == 0
+			                                                ? record.third_w - previous_third
+			                                                : record.third_w));
+		write_varint(destination, static_cast<uint32_t>(record.count));
+
+		previous_first = record.first_w;
+		previous_third = record.third_w;
+	}
+}
+
+/**
+ * Read access to the blocks of the trigram model regardless of its on-disk format
+ */
+class trigram_model
+{
+public:
+	virtual ~trigram_model() = default;
+	trigram_model() = default;
+	trigram_model(trigram_model&&) = default;
+	trigram_model(const trigram_model&) = delete;
+	trigram_model& operator=(const trigram_model&) = delete;
+	trigram_model& operator=(trigram_model&&) = default;
+
+	/**
+	 * @param second_w The int code of the middle word
+	 * @param buffer Reusable storage for formats that have to copy or decode the block
+	 * @return All records of the middle word
+	 */
+	virtual block_view read_block(int second_w, std::vector<model_record>& buffer) const = 0;
+
+	/**
+	 * @return Number of records of the middle word, taken from the index without reading the block
+	 */
+	[[nodiscard]] virtual size_t block_length(int second_w) const = 0;
+
+	/**
+	 * Pulls the whole model into the system file cache
+	 */
+	virtual void prefault() const = 0;
+};
+
+/**
+ * The original model - a stream of 16B records, blocks are located through the offset table
+ */
+class raw_trigram_model final : public trigram_model
+{
+	offset_table ot_;
+	mem_map mm_;
+	std::string file_name_;
+
+public:
+	raw_trigram_model(const std::string& file_name, offset_table&& ot) : ot_(std::move(ot)), mm_(file_name),
+	                                                                      file_name_(file_name)
+	{
+	}
+
+	block_view read_block(const int second_w, std::vector<model_record>& buffer) const override
+	{
+		const auto block = ot_.get_block(second_w);
+
+		if (mm_)
+			return block_view(mmap_binary_reader(mm_).read_block(block.offset, block.length, buffer));
+
+		// Fallback for systems on which the model could not be mapped
+		return block_view(ifstream_binary_reader(file_name_).read_block(block.offset, block.length, buffer));
+	}
+
+	[[nodiscard]] size_t block_length(const int second_w) const override
+	{
+		return static_cast<size_t>(std::max(ot_.get_block(second_w).length, 0));
+	}
+
+	void prefault() const override
+	{
+		if (mm_)
+			mm_.prefault();
+	}
+};
+
+/**
+ * Delta and varint compressed model with its own block index, blocks are decoded into the buffer on every read
+ */
+class varint_trigram_model final : public trigram_model
+{
+	mem_map mm_;
+	const block_index_entry* index_ = nullptr;
+	size_t entry_count_ = 0;
+
+public:
+	explicit varint_trigram_model(const std::string& file_name) : mm_(file_name)
+	{
+		const auto header = reinterpret_cast<const model_file_header*>(mm_.block(0, sizeof(model_file_header)));
+
+		if (!header || memcmp(header->magic, varint_model_magic, sizeof varint_model_magic) != 0)
+			return;
+
+		index_ = reinterpret_cast<const block_index_entry*>(
+			mm_.block(sizeof(model_file_header), header->entry_count * sizeof(block_index_entry)));
+
+		if (index_)
+			entry_count_ = header->entry_count;
+	}
+
+	explicit operator bool() const
+	{
+		return index_ != nullptr;
+	}
+
+	block_view read_block(const int second_w, std::vector<model_record>& buffer) const override
+	{
+		if (second_w <= 0 || static_cast<size_t>(second_w) >= entry_count_)
+			return {};
+
+		const auto& entry = index_[second_w];
+		const auto data = reinterpret_cast<const uint8_t*>(mm_.block(entry.offset, entry.size));
+
+		if (!data)
+			return {};
+
+		buffer.resize(entry.length);
+
+		auto position = data;
+		const auto end = data + entry.size;
+		int32_t first_w = 0, third_w = 0;
+
+		for (auto&& record : buffer)
+		{
+			const auto first_delta = static_cast<int32_t>(read_varint(position, end));
+			const auto third_value = static_cast<int32_t>(read_varint(position, end));
+
+			first_w += first_delta;
+			third_w = first_delta == 0 ? third_w + third_value : third_value;
+
+			record.second_w = second_w;
+			record.first_w = first_w;
+			record.third_w = third_w;
+			record.count = static_cast<int32_t>(read_varint(position, end));
+		}
+
+		// Blocks are always encoded sorted, see encode_varint_block
+		auto view = block_view(record_span(buffer.data(), buffer.data() + buffer.size()));
+		view.set_sorted();
+
+		return view;
+	}
+
+	[[nodiscard]] size_t block_length(const int second_w) const override
+	{
+		if (second_w <= 0 || static_cast<size_t>(second_w) >= entry_count_)
+			return 0;
+
+		return index_[second_w].length;
+	}
+
+	void prefault() const override
+	{
+		mm_.prefault();
+	}
+};
+
+/**
+ * Struct-of-arrays model - every block stores its first words, third words and counts as three
+ * contiguous int32 columns, blocks are located through the block index and read in place\n
+ * Models converted with sorting enabled carry the fence pointers of large blocks behind the columns
+ */
+class columnar_trigram_model final : public trigram_model
+{
+	mem_map mm_;
+	const block_index_entry* index_ = nullptr;
+	size_t entry_count_ = 0;
+	bool sorted_ = false;
+
+public:
+	explicit columnar_trigram_model(const std::string& file_name) : mm_(file_name)
+	{
+		const auto header = reinterpret_cast<const model_file_header*>(mm_.block(0, sizeof(model_file_header)));
+
+		if (!header || memcmp(header->magic, columnar_model_magic, sizeof columnar_model_magic) != 0)
+			return;
+
+		index_ = reinterpret_cast<const block_index_entry*>(
+			mm_.block(sizeof(model_file_header), header->entry_count * sizeof(block_index_entry)));
+
+		if (index_)
+		{
+			entry_count_ = header->entry_count;
+			sorted_ = header->flags & model_flag_sorted;
+		}
+	}
+
+	explicit operator bool() const
+	{
+		return index_ != nullptr;
+	}
+
+	block_view read_block(const int second_w, std::vector<model_record>&) const override
+	{
+		if (second_w <= 0 || static_cast<size_t>(second_w) >= entry_count_)
+			return {};
+
+		const auto& entry = index_[second_w];
+		const auto columns = reinterpret_cast<const int32_t*>(mm_.block(entry.offset, entry.size));
+		const auto column_size = 3 * static_cast<size_t>(entry.length) * sizeof(int32_t);
+
+		if (!columns || entry.size < column_size || entry.size % sizeof(int32_t) != 0)
+			return {};
+
+		auto view = block_view(columns, columns + entry.length, columns + 2 * entry.length, 1, entry.length);
+
+		if (sorted_)
+			view.set_sorted(columns + 3 * entry.length, (entry.size - column_size) / sizeof(int32_t));
+
+		return view;
+	}
+
+	[[nodiscard]] size_t block_length(const int second_w) const override
+	{
+		if (second_w <= 0 || static_cast<size_t>(second_w) >= entry_count_)
+			return 0;
+
+		return index_[second_w].length;
+	}
+
+	void prefault() const override
+	{
+		mm_.prefault();
+	}
+};
+
+/**
+ * Number of blocks whose records are hashed into the fingerprint of the model, spread evenly over the int codes
+ */
+constexpr size_t fingerprint_sample_blocks = 64;
+
+/**
+ * @return Hash of the content of the model regardless of its on-disk format - the number of records of every block
+ * and all records of a sample of blocks, stored in the files derived from the model to recognise a changed model
+ */
+inline uint64_t model_fingerprint(const trigram_model& model, const size_t word_count)
+{
+	const auto mix = [](uint64_t h)
+	{
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+
+		return h;
+	};
+
+	const auto step = std::max<size_t>(word_count / fingerprint_sample_blocks, 1);
+
+	std::vector<model_record> buffer;
+	uint64_t hash = 0, records = 0;
+
+	for (size_t key = 1; key <= word_count; key++)
+	{
+		const auto length = model.block_length(static_cast<int>(key));
+
+		hash = mix(hash ^ length);
+		records += length;
+
+		if (key % step != 0 || length == 0)
+			continue;
+
+		// The formats differ in the order of the records within a block, so the hashes of the records are summed
+		const auto block = model.read_block(static_cast<int>(key), buffer);
+		uint64_t sum = 0;
+
+		for (size_t i = 0; i < block.size(); i++)
+			sum += mix((static_cast<uint64_t>(static_cast<uint32_t>(block.first(i))) << 32 |
+				static_cast<uint32_t>(block.third(i))) ^ mix(static_cast<uint32_t>(block.count(i))));
+
+		hash = mix(hash ^ sum);
+	}
+
+	return mix(hash ^ records);
+}
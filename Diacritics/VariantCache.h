@@ -0,0 +1,187 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LookupStructures.h"
+
+/**
+ * Counters of a cache, a snapshot taken without stopping the threads that use the cache
+ */
+struct cache_statistics
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	size_t entries = 0;
+	size_t bytes = 0;
+};
+
+/**
+ * Number of independently locked parts of the variant cache
+ */
+constexpr size_t variant_cache_shards = 16;
+
+/**
+ * Default memory cap of the variant cache in MiB
+ */
+constexpr size_t default_variant_cache_megabytes = 64;
+
+/**
+ * Bounded cache of the int codes of the dictionary variants of prepared words, shared by all threads and all
+ * text processors of the process\n
+ * Words without any variant are cached as well (empty code lists), so the foreign words are not expanded again\n
+ * Every shard has its own lock and its part of the memory cap, a full shard evicts its oldest words first
+ */
+class variant_cache
+{
+	struct shard
+	{
+		std::shared_mutex mutex;
+		std::unordered_map<std::wstring, std::vector<int32_t>> entries;
+		std::deque<const std::wstring*> order;
+		size_t bytes = 0;
+	};
+
+	std::array<shard, variant_cache_shards> shards_;
+	size_t shard_capacity_ = 0;
+
+	std::atomic<uint64_t> hits_{0};
+	std::atomic<uint64_t> misses_{0};
+	std::atomic<uint64_t> evictions_{0};
+
+	/**
+	 * @return Approximate number of bytes an entry takes, including the node of the hash map
+	 */
+	static size_t entry_size(const std::wstring& word, const std::vector<int32_t>& ids)
+	{
+		return sizeof(std::pair<const std::wstring, std::vector<int32_t>>) + 2 * sizeof(void*) +
+			sizeof(const std::wstring*) + (word.size() + 1) * sizeof(wchar_t) + ids.size() * sizeof(int32_t);
+	}
+
+	shard& shard_of(const std::wstring& word)
+	{
+		return shards_[hash_word(word, 0) % variant_cache_shards];
+	}
+
+public:
+	variant_cache() = default;
+	variant_cache(const variant_cache&) = delete;
+	variant_cache& operator=(const variant_cache&) = delete;
+
+	/**
+	 * Sets the memory cap, 0 disables the cache, the words cached so far are dropped
+	 */
+	void set_capacity(const size_t bytes)
+	{
+		for (auto& s : shards_)
+		{
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+
+			s.entries.clear();
+			s.order.clear();
+			s.bytes = 0;
+		}
+
+		shard_capacity_ = bytes / variant_cache_shards;
+	}
+
+	bool enabled() const
+	{
+		return shard_capacity_ > 0;
+	}
+
+	/**
+	 * Copies the cached codes of the word into 'ids'
+	 *
+	 * @return False if the word is not cached
+	 */
+	bool find(const std::wstring& word, std::vector<int32_t>& ids)
+	{
+		if (!enabled())
+			return false;
+
+		auto& s = shard_of(word);
+
+		{
+			std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+			const auto it = s.entries.find(word);
+
+			if (it != s.entries.end())
+			{
+				ids = it->second;
+				hits_.fetch_add(1, std::memory_order_relaxed);
+
+				return true;
+			}
+		}
+
+		misses_.fetch_add(1, std::memory_order_relaxed);
+
+		return false;
+	}
+
+	/**
+	 * Caches the codes of the word, words that do not fit into the shard even when it is empty are not cached
+	 */
+	void insert(const std::wstring& word, const std::vector<int32_t>& ids)
+	{
+		if (!enabled())
+			return;
+
+		const auto size = entry_size(word, ids);
+
+		if (size > shard_capacity_)
+			return;
+
+		auto& s = shard_of(word);
+
+		std::unique_lock<std::shared_mutex> lock(s.mutex);
+
+		const auto inserted = s.entries.emplace(word, ids);
+
+		// Another thread has cached the word in the meantime
+		if (!inserted.second)
+			return;
+
+		s.order.push_back(&inserted.first->first);
+		s.bytes += size;
+
+		while (s.bytes > shard_capacity_)
+		{
+			const auto oldest = s.entries.find(*s.order.front());
+
+			s.bytes -= entry_size(oldest->first, oldest->second);
+			s.order.pop_front();
+			s.entries.erase(oldest);
+
+			evictions_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	cache_statistics statistics()
+	{
+		cache_statistics statistics;
+
+		statistics.hits = hits_.load(std::memory_order_relaxed);
+		statistics.misses = misses_.load(std::memory_order_relaxed);
+		statistics.evictions = evictions_.load(std::memory_order_relaxed);
+
+		for (auto& s : shards_)
+		{
+			std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+			statistics.entries += s.entries.size();
+			statistics.bytes += s.bytes;
+		}
+
+		return statistics;
+	}
+};
@@ -93,30 +93,88 @@ std::wstring get_letter_diacritics(const wchar_t c)
 }
 
 /**
- * Recursive function that generates diacritic variants for a given word
+ * @return The letter without diacritics ('á' -> 'a'), other characters are returned as they are
  */
-void get_word_variants(word_mapping& wm, std::set<std::wstring>& variants, std::wstring word, const size_t start,
+wchar_t fold_letter(const wchar_t c)
+{
+	if (c < 0x80)
+		return c;
+
+	const auto i = diacritics.find(c);
+
+	return i == std::wstring::npos ? c : non_diacritics[i];
+}
+
+/**
+ * Recursive function that generates diacritic variants for a given word\n
+ * The word is modified in place and restored before returning, dictionary probes do not allocate
+ */
+void get_word_variants(const word_mapping& wm, std::set<std::wstring>& variants, std::wstring& word, const size_t start,
                        const size_t end)
 {
 	for (auto i = start; i <= end; i++)
 	{
 		if (can_have_diacritics(word[i]))
 		{
-			auto letter_variants = get_letter_diacritics(word[i]);
+			const auto original_letter = word[i];
 
-			for (auto j = 0; j < letter_variants.size(); j++)
+			for (auto letter_variant : get_letter_diacritics(original_letter))
 			{
-				const auto word_backtrack = word;
-				word.replace(i, 1, letter_variants, j, 1);
+				word[i] = letter_variant;
 
 				if (wm.word_to_int(word) != 0)
 					variants.insert(word);
 
-				get_word_variants(wm, variants, word, start + 1, end);
-
-				word = word_backtrack;
+				// A substituted letter cannot be substituted again, continuing past it yields every combination once
+				get_word_variants(wm, variants, word, i + 1, end);
 			}
+
+			word[i] = original_letter;
+		}
+	}
+}
+
+/**
+ * Decodes UTF-8 bytes and appends them to a wide string (as UTF-16 if wchar_t only has 2 bytes)
+ */
+void append_utf8(std::wstring& destination, const std::string_view source)
+{
+	for (size_t i = 0; i < source.size();)
+	{
+		const auto lead = static_cast<unsigned char>(source[i]);
+
+		size_t length = 1;
+		uint32_t code_point = lead;
+
+		if (lead >= 0xF0)
+		{
+			length = 4;
+			code_point = lead & 0x07;
+		}
+		else if (lead >= 0xE0)
+		{
+			length = 3;
+			code_point = lead & 0x0F;
+		}
+		else if (lead >= 0xC0)
+		{
+			length = 2;
+			code_point = lead & 0x1F;
 		}
+
+		for (size_t j = 1; j < length && i + j < source.size(); j++)
+			code_point = code_point << 6 | (static_cast<unsigned char>(source[i + j]) & 0x3F);
+
+		i += length;
+
+		if (sizeof(wchar_t) == 2 && code_point > 0xFFFF)
+		{
+			code_point -= 0x10000;
+			destination.push_back(static_cast<wchar_t>(0xD800 + (code_point >> 10)));
+			destination.push_back(static_cast<wchar_t>(0xDC00 + (code_point & 0x3FF)));
+		}
+		else
+			destination.push_back(static_cast<wchar_t>(code_point));
 	}
 }
 
@@ -139,15 +197,22 @@ void delete_formatting_characters(std::wstring& word)
 	if (full_of_formatting_chars)
 		return;
 
-	word.erase(std::remove(word.begin(), word.end(), L'\''), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L'\"'), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L'.'), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L','), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L'„'), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L'“'), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L'…'), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L':'), word.end());
-	word.erase(std::remove(word.begin(), word.end(), L';'), word.end());
+	// Question and exclamation marks are kept
+	word.erase(std::remove_if(word.begin(), word.end(), [](const wchar_t c)
+	{
+		return c == L'\'' || c == L'\"' || c == L'.' || c == L',' || c == L'„' || c == L'“' || c == L'…' ||
+			c == L':' || c == L';';
+	}), word.end());
+}
+
+/**
+ * Converts a word into lowercase and removes quotes, commas, ... from it
+ */
+void prepare_word(std::wstring& word)
+{
+	delete_formatting_characters(word);
+
+	std::transform(word.begin(), word.end(), word.begin(), to_lower_case);
 }
 
 /**
@@ -156,11 +221,7 @@ void delete_formatting_characters(std::wstring& word)
 void prepare_words(std::list<std::wstring*>&& words)
 {
 	for (auto word : words)
-	{
-		delete_formatting_characters(*word);
-
-		std::transform(word->begin(), word->end(), word->begin(), to_lower_case);
-	}
+		prepare_word(*word);
 }
 
 /**
@@ -185,10 +246,13 @@ bool check_diacritic(std::wstring& word)
 /**
  * @return A set of valid (present in the dictionary) variants of a word
  */
-auto get_variants(word_mapping& wm, std::wstring& first_w) -> std::set<std::wstring>
+auto get_variants(const word_mapping& wm, std::wstring& first_w) -> std::set<std::wstring>
 {
 	std::set<std::wstring> first_w_variants;
-	get_word_variants(wm, first_w_variants, first_w, 0, first_w.size() - 1);
+
+	if (!first_w.empty())
+		get_word_variants(wm, first_w_variants, first_w, 0, first_w.size() - 1);
+
 	first_w_variants.insert(first_w);
 
 	return first_w_variants;
@@ -298,7 +362,7 @@ bool is_formatting_string(const std::wstring& s)
  */
 std::wstring apply_previous_formatting(const std::remove_reference<std::basic_string<wchar_t>&>::type&
 	reference_word,
-	const std::wstring* const unformatted_word)
+	const std::wstring_view unformatted_word)
 {
 	std::wstring result_word_with_format;
 	auto j = 0;
@@ -317,12 +381,12 @@ std::wstring apply_previous_formatting(const std::remove_reference<std::basic_st
 		}
 		else if (is_upper_case(c))
 		{
-			result_word_with_format.push_back(to_upper_case((*unformatted_word)[j]));
+			result_word_with_format.push_back(to_upper_case(unformatted_word[j]));
 			j++;
 		}
 		else
 		{
-			result_word_with_format.push_back((*unformatted_word)[j]);
+			result_word_with_format.push_back(unformatted_word[j]);
 			j++;
 		}
 	}
@@ -1,6 +1,7 @@
 #pragma once
 #include "LookupStructures.h"
 #include <string>
+#include <string_view>
 #include <set>
 #include <list>
 #include <fstream>
@@ -15,15 +16,21 @@ bool can_have_diacritics(wchar_t c);
 
 std::wstring get_letter_diacritics(wchar_t);
 
-void get_word_variants(word_mapping&, std::set<std::wstring>&, std::wstring, size_t, size_t);
+wchar_t fold_letter(wchar_t);
+
+void get_word_variants(const word_mapping&, std::set<std::wstring>&, std::wstring&, size_t, size_t);
+
+void append_utf8(std::wstring&, std::string_view);
 
 void delete_formatting_characters(std::wstring& word);
 
+void prepare_word(std::wstring& word);
+
 void prepare_words(std::list<std::wstring*>&&);
 
 bool check_diacritic(std::wstring&);
 
-auto get_variants(word_mapping&, std::wstring& first_w) -> std::set<std::wstring>;
+auto get_variants(const word_mapping&, std::wstring& first_w) -> std::set<std::wstring>;
 
 std::wstring separate_punctuation(std::wstring& word);
 
@@ -38,4 +45,4 @@ bool is_formatting_character(wchar_t);
 bool is_formatting_string(const std::wstring&);
 
 std::wstring apply_previous_formatting(const std::remove_reference<std::basic_string<wchar_t>&>::type&,
-	const std::wstring*);
\ No newline at end of file
+	std::wstring_view);
\ No newline at end of file
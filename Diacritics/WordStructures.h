@@ -1,4 +1,7 @@
 #pragma once
+#include <string>
+#include <string_view>
+
 /**
  * Stores a single word in int form
  */
@@ -76,14 +79,14 @@ struct word_triplet
 };
 
 /**
- * Stores a single word in std::wstring* format and a frequency count
+ * Stores a single word as a view into the dictionary and a frequency count
  */
 struct word_count_pair
 {
 	int count;
-	const std::wstring* word;
+	std::wstring_view word;
 
-	word_count_pair(const std::wstring* word, const int count)
+	word_count_pair(const std::wstring_view word, const int count)
 	{
 		this->count = count;
 		this->word = word;
@@ -91,25 +94,24 @@ struct word_count_pair
 };
 
 /**
- * Stores two words in std::wstring* format and a frequency count
+ * Stores two words and a frequency count
  */
 struct word_tuple_count_pair
 {
 	int count;
-	const std::wstring* first_w;
-	const std::wstring* second_w;
+	std::wstring first_w;
+	std::wstring second_w;
 
-	word_tuple_count_pair(const std::wstring* first_w, const int count)
+	word_tuple_count_pair(std::wstring first_w, const int count)
 	{
 		this->count = count;
-		this->first_w = first_w;
-		this->second_w = nullptr;
+		this->first_w = std::move(first_w);
 	}
 
-	word_tuple_count_pair(const std::wstring* first_w, const std::wstring* second_w, const int count)
+	word_tuple_count_pair(std::wstring first_w, std::wstring second_w, const int count)
 	{
 		this->count = count;
-		this->first_w = first_w;
-		this->second_w = second_w;
+		this->first_w = std::move(first_w);
+		this->second_w = std::move(second_w);
 	}
-};
+};
\ No newline at end of file